@@ -1,9 +1,27 @@
 #pragma once
 
+#include <algorithm>
+#include <bit>
+#include <chrono>
 #include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 #include "ffrmath.hpp"
 
+//define as 1 to collect PipelineStats in every Context. when 0 the counters
+//and timers compile away entirely
+#if !defined(FFR_PROFILE)
+#define FFR_PROFILE 0
+#endif
+
 namespace ffr
 {
 
@@ -15,492 +33,2367 @@ constexpr auto Convert888to555(uint8_t const r, uint8_t const g, uint8_t const b
 
 }
 
+//5 bit channels are widened by replicating their top bits into the low
+//bits, so 31 maps to 255 rather than 248
 constexpr auto Convert555to888(uint16_t color) -> ffr::util::array<uint8_t, 4>
 {
-    uint8_t const red = (color & 31) << 3;
-    uint8_t const green = ((color >> 5) & 31) << 3;
-    uint8_t const blue = ((color >> 10) & 31) << 3;
+    uint8_t const r = color & 31;
+    uint8_t const g = (color >> 5) & 31;
+    uint8_t const b = (color >> 10) & 31;
+    uint8_t const red = (r << 3) | (r >> 2);
+    uint8_t const green = (g << 3) | (g >> 2);
+    uint8_t const blue = (b << 3) | (b >> 2);
     uint8_t const alpha = 255;
     return {red,green,blue,alpha};
 }
 
-enum class DrawType : uint8_t
+//32 bit pixel layouts for the bulk converters, as uint32_t values.
+//RGBA8888 keeps red in the low byte, which is R,G,B,A in memory on little
+//endian targets. XRGB8888 is 0xffRRGGBB
+enum class PixelFormat : uint8_t
 {
-    Points = 1,
-    Lines = 2,
-    Triangles = 3
+    RGBA8888 = 1,
+    XRGB8888 = 2
 };
 
-
-class VertexFunction
+namespace
 {
-public:
-    virtual auto operator()(ffr::math::vec4& in) -> void = 0;
-};
 
-
-template<uint8_t MAX_VERTS>
-class Context
+//moves the three 5 bit channels of a 555 pixel into bytes 0, 1 and 2, red
+//in byte 0 for RGBA8888 and byte 2 for XRGB8888, then replicates the top
+//bits of every channel at once and sets alpha
+template<PixelFormat FORMAT>
+constexpr auto expand555(uint32_t const c) -> uint32_t
 {
-public:
-    Context() = default;
-    virtual ~Context() = default;
-
+    uint32_t s = 0;
+    if constexpr(FORMAT == PixelFormat::RGBA8888)
+    {
+        s = (c & 0x001F) | ((c & 0x03E0) << 3) | ((c & 0x7C00) << 6);
+    }
+    else
+    {
+        s = ((c & 0x001F) << 16) | ((c & 0x03E0) << 3) | ((c & 0x7C00) >> 10);
+    }
+    return (s << 3) | ((s >> 2) & 0x070707) | 0xFF000000;
+}
 
+//packs the 8 bit channels of a 32 bit pixel back to 555, truncating like
+//Convert888to555
+template<PixelFormat FORMAT>
+constexpr auto gather555(uint32_t const c) -> uint32_t
+{
+    uint32_t const t = (c >> 3) & 0x001F1F1F;
+    if constexpr(FORMAT == PixelFormat::RGBA8888)
+    {
+        return (t & 0x001F) | ((t >> 3) & 0x03E0) | ((t >> 6) & 0x7C00);
+    }
+    else
+    {
+        return ((t >> 16) & 0x001F) | ((t >> 3) & 0x03E0) | ((t & 0x001F) << 10);
+    }
+}
 
-    virtual auto plot(uint16_t x, uint16_t y, uint16_t color) -> void = 0;
+#if defined(__SSE2__)
+template<PixelFormat FORMAT>
+inline auto expand555(__m128i const c) -> __m128i
+{
+    __m128i const r = _mm_and_si128(c, _mm_set1_epi32(0x001F));
+    __m128i const g = _mm_slli_epi32(_mm_and_si128(c, _mm_set1_epi32(0x03E0)), 3);
+    __m128i const b = _mm_and_si128(c, _mm_set1_epi32(0x7C00));
+    __m128i s;
+    if constexpr(FORMAT == PixelFormat::RGBA8888)
+    {
+        s = _mm_or_si128(_mm_or_si128(r, g), _mm_slli_epi32(b, 6));
+    }
+    else
+    {
+        s = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(r, 16), g), _mm_srli_epi32(b, 10));
+    }
+    __m128i const low = _mm_and_si128(_mm_srli_epi32(s, 2), _mm_set1_epi32(0x070707));
+    return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(s, 3), low), _mm_set1_epi32(int32_t(0xFF000000)));
+}
 
-    auto setVertexFunction(VertexFunction* vf) -> void
+template<PixelFormat FORMAT>
+inline auto gather555(__m128i const c) -> __m128i
+{
+    __m128i const t = _mm_and_si128(_mm_srli_epi32(c, 3), _mm_set1_epi32(0x001F1F1F));
+    __m128i const g = _mm_and_si128(_mm_srli_epi32(t, 3), _mm_set1_epi32(0x03E0));
+    if constexpr(FORMAT == PixelFormat::RGBA8888)
     {
-        vertex_function_ = vf;
+        __m128i const r = _mm_and_si128(t, _mm_set1_epi32(0x001F));
+        __m128i const b = _mm_and_si128(_mm_srli_epi32(t, 6), _mm_set1_epi32(0x7C00));
+        return _mm_or_si128(_mm_or_si128(r, g), b);
     }
+    else
+    {
+        __m128i const r = _mm_srli_epi32(t, 16);
+        __m128i const b = _mm_slli_epi32(_mm_and_si128(t, _mm_set1_epi32(0x001F)), 10);
+        return _mm_or_si128(_mm_or_si128(r, g), b);
+    }
+}
+#endif
 
-    virtual auto line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) -> void
+#if defined(__AVX2__)
+template<PixelFormat FORMAT>
+inline auto expand555(__m256i const c) -> __m256i
+{
+    __m256i const r = _mm256_and_si256(c, _mm256_set1_epi32(0x001F));
+    __m256i const g = _mm256_slli_epi32(_mm256_and_si256(c, _mm256_set1_epi32(0x03E0)), 3);
+    __m256i const b = _mm256_and_si256(c, _mm256_set1_epi32(0x7C00));
+    __m256i s;
+    if constexpr(FORMAT == PixelFormat::RGBA8888)
+    {
+        s = _mm256_or_si256(_mm256_or_si256(r, g), _mm256_slli_epi32(b, 6));
+    }
+    else
     {
-        bool const steep = math::abs(y1 - y0) > math::abs(x1 - x0);
+        s = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(r, 16), g), _mm256_srli_epi32(b, 10));
+    }
+    __m256i const low = _mm256_and_si256(_mm256_srli_epi32(s, 2), _mm256_set1_epi32(0x070707));
+    return _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(s, 3), low), _mm256_set1_epi32(int32_t(0xFF000000)));
+}
+#endif
 
-        if (steep)
-        {
-            uint16_t tmp = x0;
-            x0 = y0;
-            y0 = tmp;
+}
 
-            tmp = x1;
-            x1 = y1;
-            y1 = tmp;
-        }
+//converts count 555 pixels to 32 bit pixels with bit replication and
+//opaque alpha. uses AVX2 or SSE2 when the target has them, and a
+//SWAR loop otherwise. no alignment requirements on either buffer
+template<PixelFormat FORMAT>
+inline auto Convert555to8888(uint16_t const * src, uint32_t * dst, uint32_t count) -> void
+{
+    uint32_t i = 0;
 
-        if (x0 > x1)
-        {
-            int16_t tmp = x0;
-            x0 = x1;
-            x1 = tmp;
+#if defined(__AVX2__)
+    for(; i + 16 <= count; i += 16)
+    {
+        __m256i const lo = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i)));
+        __m256i const hi = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i + 8)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), expand555<FORMAT>(lo));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i + 8), expand555<FORMAT>(hi));
+    }
+#endif
 
-            tmp = y0;
-            y0 = y1;
-            y1 = tmp;
-        }
+#if defined(__SSE2__)
+    for(; i + 8 <= count; i += 8)
+    {
+        __m128i const px = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i));
+        __m128i const lo = _mm_unpacklo_epi16(px, _mm_setzero_si128());
+        __m128i const hi = _mm_unpackhi_epi16(px, _mm_setzero_si128());
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), expand555<FORMAT>(lo));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 4), expand555<FORMAT>(hi));
+    }
+#endif
 
-        int16_t const dx    = x1 - x0;
-        int16_t const dy    = math::abs(y1 - y0);
-        int16_t error = dx / 2;
-        int16_t const ystep = (y0 < y1) ? 1 : -1;
-        int16_t y     = y0;
+    for(; i < count; ++i)
+    {
+        dst[i] = expand555<FORMAT>(src[i]);
+    }
+}
 
-        for (int16_t x = x0; x <= x1; ++x)
-        {
-            if (steep)
-            {
-                plot(y, x, color);
-            }
-            else
-            {
-                plot(x, y, color);
-            }
+//converts count 32 bit pixels to 555, dropping alpha
+template<PixelFormat FORMAT>
+inline auto Convert8888to555(uint32_t const * src, uint16_t * dst, uint32_t count) -> void
+{
+    uint32_t i = 0;
 
-            error -= dy;
-            if (error < 0)
-            {
-                y     += ystep;
-                error += dx;
-            }
-        }
+#if defined(__SSE2__)
+    for(; i + 8 <= count; i += 8)
+    {
+        __m128i const lo = gather555<FORMAT>(_mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i)));
+        __m128i const hi = gather555<FORMAT>(_mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i + 4)));
+        //15 bit results, so the signed saturating pack is exact
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packs_epi32(lo, hi));
     }
-    virtual auto lineHorizontal(int16_t x0, int16_t y0, int16_t x1, uint16_t color) -> void
+#endif
+
+    for(; i < count; ++i)
     {
-        line(x0,y0,x1,y0,color);
+        dst[i] = uint16_t(gather555<FORMAT>(src[i]));
     }
-    virtual auto lineVertical(int16_t x0, int16_t y0, int16_t y1, uint16_t color) -> void
+}
+
+//looks up count 8 bit palette indices. palette holds 256 555 colours
+//widened to 32 bits each so the AVX2 path can gather them directly
+inline auto ExpandPalette(uint8_t const * src, uint32_t const * palette, uint16_t * dst, uint32_t count) -> void
+{
+    uint32_t i = 0;
+
+#if defined(__AVX2__)
+    for(; i + 16 <= count; i += 16)
     {
-        line(x0,y0,x0,y1,color);
+        __m128i const idx = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i));
+        __m256i const lo = _mm256_i32gather_epi32(reinterpret_cast<int const *>(palette), _mm256_cvtepu8_epi32(idx), 4);
+        __m256i const hi = _mm256_i32gather_epi32(reinterpret_cast<int const *>(palette), _mm256_cvtepu8_epi32(_mm_srli_si128(idx, 8)), 4);
+        //packs within 128 bit halves, the permute puts the quarters back in order
+        __m256i const packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), packed);
     }
+#endif
 
-    virtual auto triangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color) -> void
+    for(; i < count; ++i)
     {
+        dst[i] = uint16_t(palette[src[i]]);
+    }
+}
 
-        //std::cout << x0 << ", " << x1 << ", " << y0 << ", " << y1 << ", " << x2 << ", " << y2 << "\n";
-
-        // This implementation uses only 16-bit integer math (Bresenham-style)
-        // and avoids all C++ standard library functions.
-        int16_t v_top_x = x0, v_top_y = y0;
-        int16_t v_mid_x = x1, v_mid_y = y1;
-        int16_t v_bot_x = x2, v_bot_y = y2;
-        int16_t temp_x, temp_y;
-
-        // --- 1. Manual Sort ---
-        // Sort points so v_top_y <= v_mid_y <= v_bot_y
-        if (v_top_y > v_mid_y) { temp_x = v_top_x; v_top_x = v_mid_x; v_mid_x = temp_x; temp_y = v_top_y; v_top_y = v_mid_y; v_mid_y = temp_y; }
-        if (v_mid_y > v_bot_y) { temp_x = v_mid_x; v_mid_x = v_bot_x; v_bot_x = temp_x; temp_y = v_mid_y; v_mid_y = v_bot_y; v_bot_y = temp_y; }
-        if (v_top_y > v_mid_y) { temp_x = v_top_x; v_top_x = v_mid_x; v_mid_x = temp_x; temp_y = v_top_y; v_top_y = v_mid_y; v_mid_y = temp_y; }
-
-        // --- 2. Trivial Case: Horizontal line ---
-        if (v_top_y == v_bot_y) {
-            int16_t min_x = v_top_x;
-            int16_t max_x = v_top_x;
-            if (v_mid_x < min_x) min_x = v_mid_x;
-            if (v_mid_x > max_x) max_x = v_mid_x;
-            if (v_bot_x < min_x) min_x = v_bot_x;
-            if (v_bot_x > max_x) max_x = v_bot_x;
-            lineHorizontal(min_x, v_top_y, max_x, color);
-            return;
-        }
+//converts count packed r,g,b byte triplets to 555
+inline auto ConvertRGB888to555(uint8_t const * src, uint16_t * dst, uint32_t count) -> void
+{
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        dst[i] = Convert888to555(src[0], src[1], src[2]);
+        src += 3;
+    }
+}
 
-        // --- 3. Setup Bresenham Edge Steppers ---
-        // Stepper A traces the long edge (top -> bottom)
-        int16_t dx_a = v_bot_x - v_top_x;
-        int16_t dy_a = v_bot_y - v_top_y;
-        int16_t x_step_a = 1;
-        if (dx_a < 0) { dx_a = -dx_a; x_step_a = -1; }
-        int16_t error_a = dy_a >> 1;
-        int16_t x_a = v_top_x;
-
-        // Stepper B will trace the upper int16_t edge (top -> middle) first
-        int16_t dx_b = v_mid_x - v_top_x;
-        int16_t dy_b = v_mid_y - v_top_y;
-        int16_t x_step_b = 1;
-        if (dx_b < 0) { dx_b = -dx_b; x_step_b = -1; }
-        int16_t error_b = dy_b >> 1;
-        int16_t x_b = v_top_x;
-
-        // --- 4. Top half of triangle ---
-        // This part is skipped if the triangle is flat-top (top_y == mid_y)
-        for (int16_t y = v_top_y; y < v_mid_y; y++) {
-            lineHorizontal(x_a, y, x_b, color);
-
-            // Advance stepper A along the long edge
-            error_a -= dx_a;
-            while (error_a < 0) {
-                x_a += x_step_a;
-                error_a += dy_a;
-            }
+enum class DrawType : uint8_t
+{
+    Points = 1,
+    Lines = 2,
+    Triangles = 3
+};
 
-            // Advance stepper B along the upper int16_t edge
-            if (dy_b > 0) { // Avoid division by zero on a horizontal top edge
-                error_b -= dx_b;
-                while (error_b < 0) {
-                    x_b += x_step_b;
-                    error_b += dy_b;
-                }
-            }
-        }
+//how drawn colours combine with the framebuffer, per channel and
+//saturating. Subtract takes the drawn colour away from the framebuffer
+enum class BlendMode : uint8_t
+{
+    Opaque = 0,
+    Add = 1,
+    Subtract = 2,
+    Average = 3
+};
 
-        // --- 5. Bottom half of triangle ---
-        // Re-setup stepper B for the lower int16_t edge (middle -> bottom)
-        dx_b = v_bot_x - v_mid_x;
-        dy_b = v_bot_y - v_mid_y;
-        x_step_b = 1;
-        if (dx_b < 0) { dx_b = -dx_b; x_step_b = -1; }
-        error_b = dy_b >> 1;
-        x_b = v_mid_x;
+//which triangles are discarded before rasterizing, by their winding on screen
+enum class CullMode : uint8_t
+{
+    Back = 0,
+    Front = 1,
+    None = 2
+};
 
-        for (int16_t y = v_mid_y; y <= v_bot_y; y++) {
-            lineHorizontal(x_a, y, x_b, color);
+//winding of front faces with y up, as in gl
+enum class FrontFace : uint8_t
+{
+    CounterClockwise = 0,
+    Clockwise = 1
+};
 
-            // Advance stepper A along the long edge
-            error_a -= dx_a;
-            while (error_a < 0) {
-                x_a += x_step_a;
-                error_a += dy_a;
-            }
+//packed 555 blending on whole words. every 16 bit lane of dst and src is one
+//pixel with bit 15 clear, so a uint64_t blends four pixels at once and a
+//single pixel works the same in the low lane
+template<BlendMode MODE>
+constexpr auto BlendPixels555(uint64_t const dst, uint64_t const src) -> uint64_t
+{
+    constexpr uint64_t PIXELS = 0x7FFF7FFF7FFF7FFFull;
+    constexpr uint64_t HIGH = 0x4210421042104210ull;     //top bit of every channel
+    constexpr uint64_t NOT_LOW = 0x7BDE7BDE7BDE7BDEull;  //all but the bottom bit of every channel
 
-            // Advance stepper B along the lower int16_t edge
-            if (dy_b > 0) { // Avoid division by zero on a horizontal bottom edge
-                error_b -= dx_b;
-                while (error_b < 0) {
-                    x_b += x_step_b;
-                    error_b += dy_b;
-                }
-            }
-        }
+    if constexpr(MODE == BlendMode::Opaque)
+    {
+        (void)dst;
+        return src;
+    }
+    else if constexpr(MODE == BlendMode::Average)
+    {
+        //shared bits plus half the differing ones, the mask stops the shift
+        //carrying a bit into the channel below
+        return (dst & src) + (((dst ^ src) & NOT_LOW) >> 1);
+    }
+    else if constexpr(MODE == BlendMode::Add)
+    {
+        //add the low four bits of every channel, which cannot leave the
+        //channel, then work out the top bit and carry by hand. a carry
+        //becomes 0x1F in its channel through (c << 1) - (c >> 4)
+        uint64_t const low = (dst & ~HIGH) + (src & ~HIGH);
+        uint64_t const carry = ((dst & src) | ((dst ^ src) & low)) & HIGH;
+        uint64_t const sum = low ^ ((dst ^ src) & HIGH);
+        return (sum | ((carry << 1) - (carry >> 4))) & PIXELS;
+    }
+    else
+    {
+        //dst - src == 31 - ((31 - dst) + src) per channel
+        return ~BlendPixels555<BlendMode::Add>(~dst & PIXELS, src) & PIXELS;
     }
+}
 
 
+//stages timed by the profiling counters. with the fused fetch/transform
+//path, Vertex also covers outcodes and trivial accept/reject
+enum class PipelineStage : uint8_t
+{
+    Vertex = 0,
+    Clip,
+    Divide,
+    Viewport,
+    Cull,
+    Raster,
+    Count
+};
 
-    virtual auto clear() -> void
+//what the pipeline did since the last resetStats(). cycles are TSC ticks on
+//x86 and steady_clock nanoseconds elsewhere
+class PipelineStats
+{
+public:
+    uint32_t draws = 0;
+    uint32_t draws_culled = 0;          //bounds outside the frustum
+    uint32_t draws_unclipped = 0;       //bounds inside the frustum, clipping skipped
+    uint32_t draws_occluded = 0;        //bounds hidden by the occlusion buffer, also counted as culled
+    uint32_t vertices_in = 0;           //vertices fetched
+    uint32_t vertices_out = 0;          //vertices reaching the w divide
+    uint32_t triangles_in = 0;
+    uint32_t triangles_rejected = 0;    //entirely outside one clip plane
+    uint32_t triangles_clipped = 0;     //sent through the clipper
+    uint32_t triangles_culled = 0;      //facing away or degenerate, before or after clipping
+    uint32_t triangles_degenerate = 0;  //zero area once snapped to pixels, dropped
+    uint32_t triangles_rasterized = 0;
+    uint32_t triangles_pixel = 0;       //within one pixel, plotted directly, also counted as rasterized
+    uint32_t triangles_quad = 0;        //within a 2x2 quad, a span per row, also counted as rasterized
+    uint32_t spans = 0;
+    uint32_t pixels = 0;
+    uint64_t cycles[static_cast<uint8_t>(PipelineStage::Count)] = {};
+
+    auto stageCycles(PipelineStage stage) const -> uint64_t
     {
-
+        return cycles[static_cast<uint8_t>(stage)];
     }
-    virtual auto present() -> void
-    {
+};
+
+//the counters a Context<MAX_VERTS> keeps, empty without FFR_PROFILE so
+//[[no_unique_address]] drops them. templated on the context so unprofiled
+//builds never look inside
+template<uint8_t MAX_VERTS, bool ENABLED = (FFR_PROFILE != 0)>
+class ContextStats : public PipelineStats
+{
+};
+
+template<uint8_t MAX_VERTS>
+class ContextStats<MAX_VERTS, false>
+{
+};
+
+inline auto profileClock() -> uint64_t
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+
+//storage type of vertex positions. Int16/Int8 are fixed point with
+//VertexLayout::fraction_bits below the binary point
+enum class VertexType : uint8_t
+{
+    Fixed32 = 1,
+    Int16 = 2,
+    Int8 = 3
+};
 
+//where and how positions sit in the user's vertex memory
+class VertexLayout
+{
+public:
+    VertexType type = VertexType::Fixed32;
+    uint8_t components = 3;      //2 or 3, z defaults to 0 and w to 1
+    uint16_t stride = 0;         //bytes between vertices, 0 = tightly packed
+    uint16_t offset = 0;         //bytes from the start of a vertex to its position
+    uint8_t fraction_bits = 16;  //0..16, ignored for Fixed32
+
+    auto componentSize() const -> uint16_t
+    {
+        return (type == VertexType::Fixed32) ? 4 : ((type == VertexType::Int16) ? 2 : 1);
     }
 
-    auto setVertexPointer(uint8_t size, void* vp) -> void
+    auto vertexStride() const -> uint16_t
     {
-        vertex_pointer_ = vp;
-        current_vertex_size_ = size;
+        return stride ? stride : static_cast<uint16_t>(componentSize() * components);
+    }
+};
+
+
+class VertexFunction
+{
+public:
+    virtual auto operator()(ffr::math::vec4& in) -> void = 0;
+
+    //called once per draw with the context's projection * modelview
+    virtual auto setModelViewProjection(ffr::math::mat4 const & mvp) -> void { (void)mvp; }
+};
+
 
+//everything a drawArray, drawElements or drawMesh depends on, handed to a
+//TraceSink before the draw runs. pointers reference the caller's memory
+//and are only valid during the call
+class TracedDraw
+{
+public:
+    DrawType draw_type = DrawType::Triangles;
+    uint16_t first = 0;
+    uint16_t count = 0;
+    VertexLayout layout;
+    void const * vertices = nullptr;
+    uint16_t const * colors = nullptr;
+    uint16_t const * indices = nullptr;     //drawElements only, count of them from first
+    math::mat4 mvp;                 //projection * modelview, times the model matrix for meshes
+    int16_t view_width = 0;
+    int16_t view_height = 0;
+    BlendMode blend_mode = BlendMode::Opaque;
+    CullMode cull_mode = CullMode::Back;
+    FrontFace front_face = FrontFace::CounterClockwise;
+    bool vertex_function = false;   //positions go through a VertexFunction, which is not captured
+};
+
+//observes every draw a context issues, see ffrtrace.hpp
+class TraceSink
+{
+public:
+    virtual ~TraceSink() = default;
+
+    virtual auto traceDraw(TracedDraw const & draw) -> void = 0;
+};
+
+
+//structure-of-arrays vertex storage for the pipeline stages. each lane is
+//aligned and padded to LANE_WIDTH so per-stage loops can run whole vectors
+template<uint16_t CAPACITY>
+class VertexLanes
+{
+public:
+    static constexpr uint16_t LANE_WIDTH = 4;
+    static constexpr uint16_t PADDED_CAPACITY = (CAPACITY + LANE_WIDTH - 1) & ~(LANE_WIDTH - 1);
+
+    alignas(LANE_WIDTH * sizeof(math::fixed32)) math::fixed32 x[PADDED_CAPACITY] = {};
+    alignas(LANE_WIDTH * sizeof(math::fixed32)) math::fixed32 y[PADDED_CAPACITY] = {};
+    alignas(LANE_WIDTH * sizeof(math::fixed32)) math::fixed32 z[PADDED_CAPACITY] = {};
+    alignas(LANE_WIDTH * sizeof(math::fixed32)) math::fixed32 w[PADDED_CAPACITY] = {};
+    uint16_t size = 0;
+
+    auto get(uint16_t const i) const -> math::vec4
+    {
+        return {x[i], y[i], z[i], w[i]};
     }
 
-    //1 uint16_t per primitve
-    auto setColorPointer(uint16_t* cp)-> void
+    auto set(uint16_t const i, math::vec4 const & v) -> void
     {
-        color_pointer_ = cp;
+        x[i] = v.x;
+        y[i] = v.y;
+        z[i] = v.z;
+        w[i] = v.w;
     }
-    auto setViewPort(int16_t w, int16_t h)
+
+    auto push(math::vec4 const & v) -> void
     {
-        view_width_ = w;
-        view_height_ = h;
+        set(size, v);
+        size++;
     }
 
-    auto drawArray(DrawType dt, uint16_t first, uint16_t count) -> void
+    auto capacity() const -> uint16_t
     {
+        return CAPACITY;
+    }
+};
 
-        if((!vertex_pointer_) || (!color_pointer_)) { return; }
 
-        //copy verts and cols into bufs
-        pre_clip_vert_buf_current_size_ = 0;
-        pre_clip_color_buf_current_size_ = 0;
-        post_clip_vert_buf_current_size_ = 0;
-        post_clip_color_buf_current_size_ = 0;
-        current_draw_type_ = dt;
+//coarse depth for occlusion culling. each cell holds the farthest depth of
+//the nearest occluder covering the whole cell, or CLEAR_DEPTH when none does,
+//so anything behind that depth across every cell it touches is hidden.
+//coordinates are in cells and depth is window z in [0, 1].
+//
+//an occluder's triangles are gathered at cell corners between
+//beginOccluder() and endOccluder(), and a cell is taken as covered when all
+//four of its corners are. that is exact for convex occluders, whose front
+//faces project to a convex shape with convex depth, so concave occluders
+//should be split into convex parts
+class OcclusionBuffer
+{
+public:
+    static constexpr uint16_t CLEAR_DEPTH = 0xFFFF;
 
-        if(current_vertex_size_ == 2)
+    auto clear() -> void
+    {
+        for(uint32_t i = 0; i < uint32_t(width_) * height_; ++i)
         {
-            for(uint16_t i = first; i < first + count; ++i)
-            {
-
-                pre_clip_vert_buf_[pre_clip_vert_buf_current_size_] = {reinterpret_cast<math::vec2*>(vertex_pointer_)[i].x,
-                                                                       reinterpret_cast<math::vec2*>(vertex_pointer_)[i].y,
-                                                                       0.0_fx, 1.0_fx};
-                pre_clip_vert_buf_current_size_++;
+            depth_[i] = CLEAR_DEPTH;
+        }
+    }
 
-            }
+    auto width() const -> uint16_t
+    {
+        return width_;
+    }
 
-        }
-        if(current_vertex_size_ == 3)
-        {
-            for(uint16_t i = first; i < first + count; ++i)
-            {
+    auto height() const -> uint16_t
+    {
+        return height_;
+    }
 
-                pre_clip_vert_buf_[pre_clip_vert_buf_current_size_] = {reinterpret_cast<math::vec3*>(vertex_pointer_)[i].x,
-                                                                       reinterpret_cast<math::vec3*>(vertex_pointer_)[i].y,
-                                                                       reinterpret_cast<math::vec3*>(vertex_pointer_)[i].z,
-                                                                       1.0_fx};
-                pre_clip_vert_buf_current_size_++;
+    auto depth(uint16_t x, uint16_t y) const -> uint16_t
+    {
+        return depth_[uint32_t(y) * width_ + x];
+    }
 
-            }
+    auto beginOccluder() -> void
+    {
+        corner_x0_ = width_ + 1;
+        corner_y0_ = height_ + 1;
+        corner_x1_ = 0;
+        corner_y1_ = 0;
+    }
 
+    //records the depth at the cell corners inside the triangle, either winding
+    auto rasterize(math::vec3 const & v0, math::vec3 const & v1, math::vec3 const & v2) -> void
+    {
+        //24.8 cells, so edge functions times 16 bit depths fit in 64 bits
+        int32_t const x[3] = {v0.x.raw() >> 8, v1.x.raw() >> 8, v2.x.raw() >> 8};
+        int32_t const y[3] = {v0.y.raw() >> 8, v1.y.raw() >> 8, v2.y.raw() >> 8};
+        int64_t const z[3] = {depth_of(v0.z), depth_of(v1.z), depth_of(v2.z)};
+
+        int64_t area = int64_t(x[1] - x[0]) * (y[2] - y[0]) - int64_t(x[2] - x[0]) * (y[1] - y[0]);
+        if(area == 0) { return; }
+        int64_t const sign = (area > 0) ? 1 : -1;
+        area *= sign;
+
+        //edge i is opposite vertex i: e(p) = a * px + b * py + c, >= 0 inside
+        int64_t a[3], b[3], c[3];
+        for(uint8_t i = 0; i < 3; ++i)
+        {
+            uint8_t const j = (i + 1) % 3;
+            uint8_t const k = (i + 2) % 3;
+            a[i] = sign * (y[j] - y[k]);
+            b[i] = sign * (x[k] - x[j]);
+            c[i] = sign * (int64_t(x[j]) * y[k] - int64_t(x[k]) * y[j]);
         }
 
+        int32_t const px0 = std::max((std::min({x[0], x[1], x[2]}) + 255) >> 8, int32_t(0));
+        int32_t const py0 = std::max((std::min({y[0], y[1], y[2]}) + 255) >> 8, int32_t(0));
+        int32_t const px1 = std::min(std::max({x[0], x[1], x[2]}) >> 8, int32_t(width_));
+        int32_t const py1 = std::min(std::max({y[0], y[1], y[2]}) >> 8, int32_t(height_));
+        if((px0 > px1) || (py0 > py1)) { return; }
 
+        grow_corners(px0, py0, px1, py1);
 
-        if(current_draw_type_ == DrawType::Points)
+        for(int32_t py = py0; py <= py1; ++py)
         {
-            for(uint16_t i = first; i < (first + count); ++i)
+            for(int32_t px = px0; px <= px1; ++px)
             {
-                pre_clip_color_buf_[pre_clip_color_buf_current_size_] = color_pointer_[i];
-                pre_clip_color_buf_current_size_ ++;
+                int64_t weighted = 0;
+                bool inside = true;
+                for(uint8_t i = 0; i < 3; ++i)
+                {
+                    int64_t const e = a[i] * (int64_t(px) << 8) + b[i] * (int64_t(py) << 8) + c[i];
+                    inside = inside && (e >= 0);
+                    weighted += e * z[i];
+                }
+                if(!inside) { continue; }
+
+                //rounded up, the corner depth is never nearer than the surface
+                uint16_t & d = corners_[uint32_t(py) * (width_ + 1) + uint32_t(px)];
+                uint16_t const depth = uint16_t((weighted + area - 1) / area);
+                d = (d == CLEAR_DEPTH) ? depth : std::max(d, depth);
             }
         }
-        if(current_draw_type_ == DrawType::Lines)
+    }
+
+    //cells with all four corners covered take the deepest of them
+    auto endOccluder() -> void
+    {
+        uint32_t const pitch = width_ + 1;
+        for(int32_t cy = corner_y0_; cy < corner_y1_; ++cy)
         {
-            for(uint16_t i = first; i < (first + count) / 2; ++i)
+            for(int32_t cx = corner_x0_; cx < corner_x1_; ++cx)
             {
-                pre_clip_color_buf_[pre_clip_color_buf_current_size_] = color_pointer_[i];
-                pre_clip_color_buf_current_size_ ++;
+                uint16_t const * const corner = corners_ + uint32_t(cy) * pitch + uint32_t(cx);
+                uint16_t const c00 = corner[0];
+                uint16_t const c10 = corner[1];
+                uint16_t const c01 = corner[pitch];
+                uint16_t const c11 = corner[pitch + 1];
+                if((c00 == CLEAR_DEPTH) || (c10 == CLEAR_DEPTH) || (c01 == CLEAR_DEPTH) || (c11 == CLEAR_DEPTH)) { continue; }
+
+                uint16_t & d = depth_[uint32_t(cy) * width_ + uint32_t(cx)];
+                d = std::min(d, std::max({c00, c10, c01, c11}));
             }
-
         }
-        if(current_draw_type_ == DrawType::Triangles)
+        beginOccluder();
+    }
+
+    //true if every cell in [x0, x1) x [y0, y1) holds an occluder nearer than
+    //depth. an empty rectangle is not occluded
+    auto occludes(int32_t x0, int32_t y0, int32_t x1, int32_t y1, math::fixed32 const depth) const -> bool
+    {
+        x0 = std::max(x0, int32_t(0));
+        y0 = std::max(y0, int32_t(0));
+        x1 = std::min(x1, int32_t(width_));
+        y1 = std::min(y1, int32_t(height_));
+        if((x0 >= x1) || (y0 >= y1)) { return false; }
+
+        //a few units of slack for rounding in the two transforms
+        int64_t const nearest = depth_of(depth) - 4;
+        for(int32_t y = y0; y < y1; ++y)
         {
-            for(uint16_t i = first; i < (first + count) / 3; ++i)
+            uint16_t const * const row = depth_ + uint32_t(y) * width_;
+            for(int32_t x = x0; x < x1; ++x)
             {
-                pre_clip_color_buf_[pre_clip_color_buf_current_size_] = color_pointer_[i];
-                pre_clip_color_buf_current_size_ ++;
+                if(row[x] >= nearest) { return false; }
             }
-
         }
+        return true;
+    }
 
-        vertex_pipeline();
-
+protected:
+    //depth holds width * height cells, corners (width + 1) * (height + 1)
+    OcclusionBuffer(uint16_t * depth, uint16_t * corners, uint16_t const width, uint16_t const height)
+        : depth_(depth), corners_(corners), width_(width), height_(height)
+    {
+        beginOccluder();
     }
 
-    void terrain(math::vec2 p,
-                 math::fixed32 phi,
-                 int16_t height,
-                 int16_t horizon,
-                 int16_t scale_height,
-                 int16_t distance,
-                 int16_t screen_width, int16_t screen_height,
-                 uint8_t const * const hm,
-                 uint16_t const * const cm)
+private:
+    uint16_t * depth_;
+    uint16_t * corners_;
+    uint16_t width_;
+    uint16_t height_;
+
+    //corners touched by the current occluder, inclusive
+    int32_t corner_x0_ = 0;
+    int32_t corner_y0_ = 0;
+    int32_t corner_x1_ = 0;
+    int32_t corner_y1_ = 0;
+
+    static auto depth_of(math::fixed32 const z) -> int64_t
     {
-        //# Call the render function with the camera parameters:
-        //# position, viewing angle, height, horizon line position,
-        //# scaling factor for the height, the largest distance,
-        //# screen width and the screen height parameter
-        //Render( Point(0, 0), 0, 50, 120, 120, 300, 800, 600 )
+        return std::clamp<int64_t>(z.raw(), 0, CLEAR_DEPTH - 1);
+    }
 
-        uint8_t ybuffer[256];
-        for (uint16_t i = 0; i < 256; ++i)
+    //extends the touched rectangle, the first touch of a corner clears it
+    auto grow_corners(int32_t const x0, int32_t const y0, int32_t const x1, int32_t const y1) -> void
+    {
+        int32_t const nx0 = std::min(corner_x0_, x0);
+        int32_t const ny0 = std::min(corner_y0_, y0);
+        int32_t const nx1 = std::max(corner_x1_, x1);
+        int32_t const ny1 = std::max(corner_y1_, y1);
+        for(int32_t py = ny0; py <= ny1; ++py)
         {
-            ybuffer[i] = screen_height;
+            for(int32_t px = nx0; px <= nx1; ++px)
+            {
+                bool const seen = (px >= corner_x0_) && (px <= corner_x1_) && (py >= corner_y0_) && (py <= corner_y1_);
+                if(!seen) { corners_[uint32_t(py) * (width_ + 1) + uint32_t(px)] = CLEAR_DEPTH; }
+            }
         }
+        corner_x0_ = nx0;
+        corner_y0_ = ny0;
+        corner_x1_ = nx1;
+        corner_y1_ = ny1;
+    }
+};
 
-        //# precalculate viewing angle parameters
-        math::fixed32 sinphi = ffr::math::sin(phi);
-        math::fixed32 cosphi = ffr::math::cos(phi);
+template<uint16_t WIDTH, uint16_t HEIGHT>
+class CoarseDepthBuffer : public OcclusionBuffer
+{
+public:
+    CoarseDepthBuffer()
+        : OcclusionBuffer(cells_, corners_, WIDTH, HEIGHT)
+    {
+        clear();
+    }
+
+    CoarseDepthBuffer(CoarseDepthBuffer const &) = delete;
+    auto operator=(CoarseDepthBuffer const &) -> CoarseDepthBuffer & = delete;
+
+private:
+    uint16_t cells_[uint32_t(WIDTH) * HEIGHT];
+    uint16_t corners_[uint32_t(WIDTH + 1) * (HEIGHT + 1)];
+};
+
+
+//the span rasterizer behind Context::triangle. span(xa, y, xb) is called
+//for every covered row with xa and xb inclusive and in either order.
+//templated on the span writer, so a backend that passes its own fill gets
+//the whole loop inlined around it
+template<class SPAN>
+constexpr auto rasterizeTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, SPAN && span) -> void
+{
+    // This implementation uses only 16-bit integer math (Bresenham-style)
+    // and avoids all C++ standard library functions.
+    int16_t v_top_x = x0, v_top_y = y0;
+    int16_t v_mid_x = x1, v_mid_y = y1;
+    int16_t v_bot_x = x2, v_bot_y = y2;
+    int16_t temp_x, temp_y;
+
+    // --- 1. Manual Sort ---
+    // Sort points so v_top_y <= v_mid_y <= v_bot_y
+    if (v_top_y > v_mid_y) { temp_x = v_top_x; v_top_x = v_mid_x; v_mid_x = temp_x; temp_y = v_top_y; v_top_y = v_mid_y; v_mid_y = temp_y; }
+    if (v_mid_y > v_bot_y) { temp_x = v_mid_x; v_mid_x = v_bot_x; v_bot_x = temp_x; temp_y = v_mid_y; v_mid_y = v_bot_y; v_bot_y = temp_y; }
+    if (v_top_y > v_mid_y) { temp_x = v_top_x; v_top_x = v_mid_x; v_mid_x = temp_x; temp_y = v_top_y; v_top_y = v_mid_y; v_mid_y = temp_y; }
+
+    // --- 2. Trivial Case: Horizontal line ---
+    if (v_top_y == v_bot_y) {
+        int16_t min_x = v_top_x;
+        int16_t max_x = v_top_x;
+        if (v_mid_x < min_x) min_x = v_mid_x;
+        if (v_mid_x > max_x) max_x = v_mid_x;
+        if (v_bot_x < min_x) min_x = v_bot_x;
+        if (v_bot_x > max_x) max_x = v_bot_x;
+        span(min_x, v_top_y, max_x);
+        return;
+    }
+
+    // --- 3. Setup Bresenham Edge Steppers ---
+    // Stepper A traces the long edge (top -> bottom)
+    int16_t dx_a = v_bot_x - v_top_x;
+    int16_t dy_a = v_bot_y - v_top_y;
+    int16_t x_step_a = 1;
+    if (dx_a < 0) { dx_a = -dx_a; x_step_a = -1; }
+    int16_t error_a = dy_a >> 1;
+    int16_t x_a = v_top_x;
+
+    // Stepper B will trace the upper int16_t edge (top -> middle) first
+    int16_t dx_b = v_mid_x - v_top_x;
+    int16_t dy_b = v_mid_y - v_top_y;
+    int16_t x_step_b = 1;
+    if (dx_b < 0) { dx_b = -dx_b; x_step_b = -1; }
+    int16_t error_b = dy_b >> 1;
+    int16_t x_b = v_top_x;
+
+    // --- 4. Top half of triangle ---
+    // This part is skipped if the triangle is flat-top (top_y == mid_y)
+    for (int16_t y = v_top_y; y < v_mid_y; y++) {
+        span(x_a, y, x_b);
+
+        // Advance stepper A along the long edge
+        error_a -= dx_a;
+        while (error_a < 0) {
+            x_a += x_step_a;
+            error_a += dy_a;
+        }
+
+        // Advance stepper B along the upper int16_t edge
+        if (dy_b > 0) { // Avoid division by zero on a horizontal top edge
+            error_b -= dx_b;
+            while (error_b < 0) {
+                x_b += x_step_b;
+                error_b += dy_b;
+            }
+        }
+    }
+
+    // --- 5. Bottom half of triangle ---
+    // Re-setup stepper B for the lower int16_t edge (middle -> bottom)
+    dx_b = v_bot_x - v_mid_x;
+    dy_b = v_bot_y - v_mid_y;
+    x_step_b = 1;
+    if (dx_b < 0) { dx_b = -dx_b; x_step_b = -1; }
+    error_b = dy_b >> 1;
+    x_b = v_mid_x;
+
+    for (int16_t y = v_mid_y; y <= v_bot_y; y++) {
+        span(x_a, y, x_b);
+
+        // Advance stepper A along the long edge
+        error_a -= dx_a;
+        while (error_a < 0) {
+            x_a += x_step_a;
+            error_a += dy_a;
+        }
+
+        // Advance stepper B along the lower int16_t edge
+        if (dy_b > 0) { // Avoid division by zero on a horizontal bottom edge
+            error_b -= dx_b;
+            while (error_b < 0) {
+                x_b += x_step_b;
+                error_b += dy_b;
+            }
+        }
+    }
+}
+
+//the Bresenham walk behind Context::line. plot(x, y) is called for every
+//pixel from end to end, which may lie off screen
+template<class PLOT>
+constexpr auto rasterizeLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, PLOT && plot) -> void
+{
+    bool const steep = math::abs(y1 - y0) > math::abs(x1 - x0);
+
+    if (steep)
+    {
+        uint16_t tmp = x0;
+        x0 = y0;
+        y0 = tmp;
+
+        tmp = x1;
+        x1 = y1;
+        y1 = tmp;
+    }
+
+    if (x0 > x1)
+    {
+        int16_t tmp = x0;
+        x0 = x1;
+        x1 = tmp;
+
+        tmp = y0;
+        y0 = y1;
+        y1 = tmp;
+    }
+
+    int16_t const dx    = x1 - x0;
+    int16_t const dy    = math::abs(y1 - y0);
+    int16_t error = dx / 2;
+    int16_t const ystep = (y0 < y1) ? 1 : -1;
+    int16_t y     = y0;
+
+    for (int16_t x = x0; x <= x1; ++x)
+    {
+        if (steep)
+        {
+            plot(y, x);
+        }
+        else
+        {
+            plot(x, y);
+        }
+
+        error -= dy;
+        if (error < 0)
+        {
+            y     += ystep;
+            error += dx;
+        }
+    }
+}
+
+
+template<uint8_t MAX_VERTS>
+class Context;
+
+//a retained draw whose screen-space vertices are cached by the context.
+//the vertex stage is skipped on later draws until the model matrix, the
+//context's projection * modelview, the viewport or the culling changes. call
+//invalidate() after editing the referenced vertex or colour data
+template<uint8_t MAX_VERTS>
+class Mesh
+{
+public:
+    auto setVertexPointer(uint8_t size, void const * vp) -> void
+    {
+        VertexLayout layout;
+        layout.components = size;
+        setVertexPointer(layout, vp);
+    }
+
+    auto setVertexPointer(VertexLayout const & layout, void const * vp) -> void
+    {
+        vertex_pointer_ = vp;
+        vertex_layout_ = layout;
+        valid_ = false;
+    }
+
+    //1 uint16_t per primitve
+    auto setColorPointer(uint16_t const * cp) -> void
+    {
+        color_pointer_ = cp;
+        valid_ = false;
+    }
+
+    auto setDrawRange(DrawType dt, uint16_t first, uint16_t count) -> void
+    {
+        draw_type_ = dt;
+        first_ = first;
+        count_ = count;
+        valid_ = false;
+    }
+
+    auto setMatrix(math::mat4 const & model) -> void
+    {
+        model_ = model;
+        valid_ = false;
+    }
+
+    //model space bounds of the drawn vertices. the mesh is culled against
+    //the frustum when its cache is rebuilt
+    auto setBounds(math::aabb const & bounds) -> void
+    {
+        box_ = bounds;
+        bounds_ = Bounds::Box;
+        valid_ = false;
+    }
+
+    auto setBounds(math::sphere const & bounds) -> void
+    {
+        sphere_ = bounds;
+        bounds_ = Bounds::Sphere;
+        valid_ = false;
+    }
+
+    auto invalidate() -> void
+    {
+        valid_ = false;
+    }
+
+    auto isCached() const -> bool
+    {
+        return valid_;
+    }
+
+private:
+    friend class Context<MAX_VERTS>;
+
+    void const * vertex_pointer_ = nullptr;
+    VertexLayout vertex_layout_;
+    uint16_t const * color_pointer_ = nullptr;
+    DrawType draw_type_ = DrawType::Triangles;
+    uint16_t first_ = 0;
+    uint16_t count_ = 0;
+    math::mat4 model_;
+
+    enum class Bounds : uint8_t { None, Box, Sphere };
+    Bounds bounds_ = Bounds::None;
+    math::aabb box_;
+    math::sphere sphere_;
+
+    bool valid_ = false;
+    math::mat4 cached_mvp_;
+    int16_t cached_view_width_ = 0;
+    int16_t cached_view_height_ = 0;
+    CullMode cached_cull_mode_ = CullMode::Back;
+    FrontFace cached_front_face_ = FrontFace::CounterClockwise;
+    VertexLanes<MAX_VERTS> screen_verts_;
+    ffr::util::array<uint16_t, MAX_VERTS> screen_colors_;
+};
+
+
+template<uint8_t MAX_VERTS>
+class Context
+{
+public:
+    Context() = default;
+    virtual ~Context() = default;
+
+
+
+    virtual auto plot(uint16_t x, uint16_t y, uint16_t color) -> void = 0;
+
+    //with no vertex function set, vertices are transformed by the matrix stack
+    auto setVertexFunction(VertexFunction* vf) -> void
+    {
+        vertex_function_ = vf;
+    }
+
+    auto vertexFunction() const -> VertexFunction *
+    {
+        return vertex_function_;
+    }
+
+    auto setProjection(math::mat4 const & pj) -> void
+    {
+        projection_ = pj;
+        mvp_dirty_ = true;
+    }
+
+    //modelview stack, GL style. push/pop past the ends are ignored
+    auto pushMatrix() -> void
+    {
+        if(matrix_stack_top_ + 1 >= MATRIX_STACK_DEPTH) { return; }
+        matrix_stack_[matrix_stack_top_ + 1] = matrix_stack_[matrix_stack_top_];
+        matrix_stack_top_++;
+    }
+
+    auto popMatrix() -> void
+    {
+        if(matrix_stack_top_ == 0) { return; }
+        matrix_stack_top_--;
+        mvp_dirty_ = true;
+    }
+
+    auto loadIdentity() -> void
+    {
+        matrix_stack_[matrix_stack_top_] = math::mat4{};
+        mvp_dirty_ = true;
+    }
+
+    auto loadMatrix(math::mat4 const & m) -> void
+    {
+        matrix_stack_[matrix_stack_top_] = m;
+        mvp_dirty_ = true;
+    }
+
+    //top = top * m, using the affine multiply when both sides allow it
+    auto multMatrix(math::mat4 const & m) -> void
+    {
+        math::mat4 & top = matrix_stack_[matrix_stack_top_];
+        top = (top.isAffine() && m.isAffine()) ? top.mulAffine(m) : top * m;
+        mvp_dirty_ = true;
+    }
+
+    auto modelView() const -> math::mat4 const &
+    {
+        return matrix_stack_[matrix_stack_top_];
+    }
+
+    //projection * modelview, recomputed only after the stack or projection changed
+    auto modelViewProjection() -> math::mat4 const &
+    {
+        if(mvp_dirty_)
+        {
+            mvp_ = projection_ * matrix_stack_[matrix_stack_top_];
+            mvp_dirty_ = false;
+        }
+        return mvp_;
+    }
+
+    virtual auto line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) -> void
+    {
+        rasterizeLine(x0, y0, x1, y1, [&](int16_t x, int16_t y) {
+            plot(uint16_t(x), uint16_t(y), color);
+        });
+    }
+    virtual auto lineHorizontal(int16_t x0, int16_t y0, int16_t x1, uint16_t color) -> void
+    {
+        line(x0,y0,x1,y0,color);
+    }
+    virtual auto lineVertical(int16_t x0, int16_t y0, int16_t y1, uint16_t color) -> void
+    {
+        line(x0,y0,x0,y1,color);
+    }
+
+    //only sees triangles wider or taller than 2 pixels. the default
+    //rasterStage triages smaller ones first: a single pixel goes to plot(),
+    //one within a 2x2 quad to one lineHorizontal() per row, and zero area
+    //ones are dropped
+    virtual auto triangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color) -> void
+    {
+        rasterizeTriangle(x0, y0, x1, y1, x2, y2, [&](int16_t xa, int16_t y, int16_t xb) {
+            lineHorizontal(xa, y, xb, color);
+        });
+    }
+
+
+
+    virtual auto clear() -> void
+    {
+
+    }
+    virtual auto present() -> void
+    {
+
+    }
+
+    //tightly packed fixed32 positions with size components
+    auto setVertexPointer(uint8_t size, void const * vp) -> void
+    {
+        VertexLayout layout;
+        layout.components = size;
+        setVertexPointer(layout, vp);
+    }
+
+    auto setVertexPointer(VertexLayout const & layout, void const * vp) -> void
+    {
+        vertex_pointer_ = vp;
+        vertex_layout_ = layout;
+    }
+
+    //1 uint16_t per primitve
+    auto setColorPointer(uint16_t const * cp)-> void
+    {
+        color_pointer_ = cp;
+    }
+
+    //applies to the following draws. backends that cannot blend draw opaque
+    auto setBlendMode(BlendMode mode) -> void
+    {
+        blend_mode_ = mode;
+    }
+
+    auto blendMode() const -> BlendMode
+    {
+        return blend_mode_;
+    }
+
+    //applies to the following triangle draws
+    auto setCullMode(CullMode mode) -> void
+    {
+        cull_mode_ = mode;
+    }
+
+    auto cullMode() const -> CullMode
+    {
+        return cull_mode_;
+    }
+
+    auto setFrontFace(FrontFace face) -> void
+    {
+        front_face_ = face;
+    }
+
+    auto frontFace() const -> FrontFace
+    {
+        return front_face_;
+    }
+
+    //every following drawArray, drawElements and drawMesh is reported to
+    //sink, nullptr stops tracing
+    auto setTraceSink(TraceSink * sink) -> void
+    {
+        trace_sink_ = sink;
+    }
+
+    //copy of the counters gathered since the last reset, all zero unless
+    //built with FFR_PROFILE
+    auto snapshotStats() const -> PipelineStats
+    {
+        if constexpr(PROFILE) { return stats_; }
+        else { return PipelineStats{}; }
+    }
+
+    auto resetStats() -> void
+    {
+        if constexpr(PROFILE) { stats_ = ContextStats<MAX_VERTS>{}; }
+    }
+    auto setViewPort(int16_t w, int16_t h)
+    {
+        view_width_ = w;
+        view_height_ = h;
+    }
+
+    //where a bound, given in the space the modelview maps from, lies
+    //against the frustum of the current projection * modelview
+    auto cull(math::aabb const & bounds) -> math::Containment
+    {
+        return math::frustum::fromMatrix(modelViewProjection()).classify(bounds);
+    }
+
+    auto cull(math::sphere const & bounds) -> math::Containment
+    {
+        return math::frustum::fromMatrix(modelViewProjection()).classify(bounds);
+    }
+
+    //draws nothing for bounds outside the frustum or hidden by the
+    //occlusion buffer, and skips clipping for bounds inside the frustum
+    auto drawArray(DrawType dt, uint16_t first, uint16_t count, math::aabb const & bounds) -> void
+    {
+        math::Containment containment = vertex_function_ ? math::Containment::Intersecting : cull(bounds);
+        if((containment != math::Containment::Outside) && (!vertex_function_) && occluded(bounds))
+        {
+            profile_count(&PipelineStats::draws_occluded, 1);
+            containment = math::Containment::Outside;
+        }
+        drawArray(dt, first, count, containment);
+    }
+
+    auto drawArray(DrawType dt, uint16_t first, uint16_t count, math::sphere const & bounds) -> void
+    {
+        drawArray(dt, first, count, vertex_function_ ? math::Containment::Intersecting : cull(bounds));
+    }
+
+    //occlusion culling. occluders are drawn into buffer, which bounded draws
+    //are then tested against. the caller clears it, normally once a frame.
+    //nullptr turns occlusion culling off
+    auto setOcclusionBuffer(OcclusionBuffer * buffer) -> void
+    {
+        occlusion_ = buffer;
+    }
+
+    //rasterizes the unculled triangles of the current vertex pointer into
+    //the occlusion buffer through the matrix stack, nothing is drawn. the
+    //colour pointer is not read but must be set as for drawArray
+    auto drawOccluder(uint16_t first, uint16_t count) -> void
+    {
+        if((!occlusion_) || (!vertex_pointer_) || (!color_pointer_)) { return; }
+
+        post_clip_vert_buf_.size = 0;
+        post_clip_color_buf_current_size_ = 0;
+        current_draw_type_ = DrawType::Triangles;
+
+        math::mat4 const & mvp = modelViewProjection();
+        with_vertex_layout(vertex_layout_, [&]<class T, uint8_t COMPONENTS>() {
+            fused_pipeline<T, COMPONENTS>(vertex_pointer_, vertex_layout_, color_pointer_, mvp, first, count, true);
+        });
+        project_post_clip();
+        rasterize_occluder(post_clip_vert_buf_);
+    }
+
+    //a triangle mesh as an occluder, reusing and refreshing its cache
+    auto drawOccluder(Mesh<MAX_VERTS> & mesh) -> void
+    {
+        if((!occlusion_) || (!mesh.vertex_pointer_) || (!mesh.color_pointer_) || (mesh.draw_type_ != DrawType::Triangles))
+        {
+            return;
+        }
+
+        current_draw_type_ = mesh.draw_type_;
+        update_mesh(mesh, modelViewProjection() * mesh.model_);
+        rasterize_occluder(mesh.screen_verts_);
+    }
+
+    //true if the occlusion buffer proves bounds, given in the space the
+    //modelview maps from, hidden. false without a buffer
+    auto occluded(math::aabb const & bounds) -> bool
+    {
+        return occlusion_ && occluded_by(modelViewProjection(), bounds);
+    }
+
+    //containment is a cull() result for these vertices or for a group that
+    //encloses them, so a hierarchy only tests children of intersecting
+    //groups. ignored while a vertex function, which may move vertices
+    //anywhere, is set
+    auto drawArray(DrawType dt, uint16_t first, uint16_t count,
+                   math::Containment containment = math::Containment::Intersecting) -> void
+    {
+
+        if((!vertex_pointer_) || (!color_pointer_)) { return; }
+        profile_count(&PipelineStats::draws, 1);
+        if(trace_sink_) { trace_draw(dt, first, count, vertex_layout_, vertex_pointer_, color_pointer_, modelViewProjection()); }
+
+        if(vertex_function_) { containment = math::Containment::Intersecting; }
+        if(containment == math::Containment::Outside)
+        {
+            profile_count(&PipelineStats::draws_culled, 1);
+            return;
+        }
+        bool const clip = (containment != math::Containment::Inside);
+        profile_count(&PipelineStats::draws_unclipped, clip ? 0 : 1);
+
+        pre_clip_vert_buf_.size = 0;
+        pre_clip_color_buf_current_size_ = 0;
+        post_clip_vert_buf_.size = 0;
+        post_clip_color_buf_current_size_ = 0;
+        current_draw_type_ = dt;
+
+        //without a vertex function, fetch, transform and outcode run in one
+        //pass over the user's memory and only surviving vertices are stored
+        if((!vertex_function_) && (current_draw_type_ != DrawType::Lines))
+        {
+            math::mat4 const & mvp = modelViewProjection();
+            with_vertex_layout(vertex_layout_, [&]<class T, uint8_t COMPONENTS>() {
+                fused_pipeline<T, COMPONENTS>(vertex_pointer_, vertex_layout_, color_pointer_, mvp, first, count, clip);
+            });
+            finish_pipeline();
+            return;
+        }
+
+        //the staged path holds the whole draw in the pre-clip lanes, so only
+        //the whole primitives that fit are drawn
+        uint16_t const per_color = (dt == DrawType::Triangles) ? 3 : ((dt == DrawType::Lines) ? 2 : 1);
+        uint16_t const fits = pre_clip_vert_buf_.capacity() - (pre_clip_vert_buf_.capacity() % per_color);
+        count = std::min(count, fits);
+
+        //copy verts and cols into bufs
+        with_vertex_layout(vertex_layout_, [&]<class T, uint8_t COMPONENTS>() { fetch_positions<T, COMPONENTS>(first, count); });
+
+        uint32_t const color_first = first / per_color;
+        uint32_t const color_end = (uint32_t(first) + count) / per_color;
+        for(uint32_t i = color_first; i < color_end; ++i)
+        {
+            pre_clip_color_buf_[pre_clip_color_buf_current_size_] = color_pointer_[i];
+            pre_clip_color_buf_current_size_ ++;
+        }
+
+        vertex_pipeline();
+
+    }
+
+    //indexed triangles or points. count indices from first each name a vertex
+    //of the vertex pointer, colours are per primitive as for drawArray.
+    //when the indices span no more than MAX_VERTS vertices, each of them is
+    //transformed and outcoded once however many triangles share it. unlike
+    //drawArray the triangles are not limited by the post-clip lanes, which
+    //are rasterized whenever they fill up
+    auto drawElements(DrawType dt, uint16_t first, uint16_t count, uint16_t const * indices) -> void
+    {
+        if((!vertex_pointer_) || (!color_pointer_) || (!indices) || (dt == DrawType::Lines) || (count == 0)) { return; }
+        profile_count(&PipelineStats::draws, 1);
+
+        if(trace_sink_)
+        {
+            trace_draw(dt, first, count, vertex_layout_, vertex_pointer_, color_pointer_, modelViewProjection(), indices);
+        }
+
+        pre_clip_vert_buf_.size = 0;
+        post_clip_vert_buf_.size = 0;
+        post_clip_color_buf_current_size_ = 0;
+        current_draw_type_ = dt;
+
+        uint16_t const * const elements = indices + first;
+        uint16_t lo = UINT16_MAX;
+        uint16_t hi = 0;
+        for(uint16_t i = 0; i < count; ++i)
+        {
+            lo = std::min(lo, elements[i]);
+            hi = std::max(hi, elements[i]);
+        }
+
+        VertexLanes<MAX_VERTS> & pre = pre_clip_vert_buf_;
+        if(uint32_t(hi - lo) >= pre.capacity())
+        {
+            with_vertex_layout(vertex_layout_, [&]<class T, uint8_t COMPONENTS>() {
+                unshared_elements<T, COMPONENTS>(first, count, elements);
+            });
+            finish_pipeline();
+            return;
+        }
+
+        with_vertex_layout(vertex_layout_, [&]<class T, uint8_t COMPONENTS>() { fetch_positions<T, COMPONENTS>(lo, hi - lo + 1); });
+        vertex_stage();
+
+        uint64_t const t = profile_clock();
+        if(dt == DrawType::Triangles) { compute_outcodes(pre); }
+        assemble_elements(first, count, [&](uint16_t const i, uint8_t & oc) -> math::vec4 {
+            uint16_t const v = elements[i] - lo;
+            oc = pre_clip_outcode_buf_[v];
+            return pre.get(v);
+        });
+        profile_stage(PipelineStage::Clip, t);
+
+        finish_pipeline();
+    }
+
+    //draws a retained mesh through the fixed-function transform, re-running the
+    //vertex stage only when its cached screen-space vertices are stale
+    auto drawMesh(Mesh<MAX_VERTS> & mesh) -> void
+    {
+        if((!mesh.vertex_pointer_) || (!mesh.color_pointer_)) { return; }
+        profile_count(&PipelineStats::draws, 1);
+
+        current_draw_type_ = mesh.draw_type_;
+
+        math::mat4 const mvp = modelViewProjection() * mesh.model_;
+        if(trace_sink_)
+        {
+            trace_draw(mesh.draw_type_, mesh.first_, mesh.count_, mesh.vertex_layout_, mesh.vertex_pointer_, mesh.color_pointer_, mvp);
+        }
+
+        //occlusion changes every frame, so it is tested on every draw rather than cached
+        if(occlusion_ && (mesh.bounds_ == Mesh<MAX_VERTS>::Bounds::Box) && occluded_by(mvp, mesh.box_))
+        {
+            profile_count(&PipelineStats::draws_culled, 1);
+            profile_count(&PipelineStats::draws_occluded, 1);
+            return;
+        }
+
+        update_mesh(mesh, mvp);
+        rasterize(mesh.screen_verts_, mesh.screen_colors_);
+    }
+
+    void terrain(math::vec2 p,
+                 math::fixed32 phi,
+                 int16_t height,
+                 int16_t horizon,
+                 int16_t scale_height,
+                 int16_t distance,
+                 int16_t screen_width, int16_t screen_height,
+                 uint8_t const * const hm,
+                 uint16_t const * const cm)
+    {
+        //# Call the render function with the camera parameters:
+        //# position, viewing angle, height, horizon line position,
+        //# scaling factor for the height, the largest distance,
+        //# screen width and the screen height parameter
+        //Render( Point(0, 0), 0, 50, 120, 120, 300, 800, 600 )
+
+        uint8_t ybuffer[256];
+        for (uint16_t i = 0; i < 256; ++i)
+        {
+            ybuffer[i] = screen_height;
+        }
+
+        //# precalculate viewing angle parameters
+        math::SinCos const scphi = ffr::math::sincos(phi);
+        math::fixed32 sinphi = scphi.sin;
+        math::fixed32 cosphi = scphi.cos;
 
         //# initialize visibility array. Y position for each column on screen
 
 
-        //# Draw from front to the back (low z coordinate to high z coordinate)
-        math::fixed32 dz = 1.0_fx;
-        math::fixed32 z = 1.0_fx;
-        math::fixed32 dist32 (distance);
-        while (z < dist32)
-        {
-            //# Find line on map. This calculation corresponds to a field of view of 90°
-            auto pleft = math::vec2{ ((-cosphi*z - sinphi*z) + p.x, ( sinphi*z - cosphi*z) + p.y) };
-            auto pright = math::vec2{ (( cosphi*z - sinphi*z) + p.x, (-sinphi*z - cosphi*z) + p.y) };
+        //# Draw from front to the back (low z coordinate to high z coordinate)
+        math::fixed32 dz = 1.0_fx;
+        math::fixed32 z = 1.0_fx;
+        math::fixed32 dist32 (distance);
+        while (z < dist32)
+        {
+            //# Find line on map. This calculation corresponds to a field of view of 90°
+            auto pleft = math::vec2{ ((-cosphi*z - sinphi*z) + p.x, ( sinphi*z - cosphi*z) + p.y) };
+            auto pright = math::vec2{ (( cosphi*z - sinphi*z) + p.x, (-sinphi*z - cosphi*z) + p.y) };
+
+            //# segment the line
+            math::fixed32 dx = static_cast<math::fixed32>(static_cast<int16_t>((pright.x - pleft.x) / math::fixed32(screen_width)));
+            math::fixed32 dy = static_cast<math::fixed32>(static_cast<int16_t>((pright.y - pleft.y) / math::fixed32(screen_width)));
+
+            //# Raster line and draw a vertical line for each segment
+            for (math::fixed32 i=0.0_fx; i < math::fixed32(screen_width); i = i + 1.0_fx)
+            {
+                // auto height_on_screen = (height - hm[pleft.x, pleft.y]) / z * scale_height + horizon;
+                // //lineVertical(i, height_on_screen, ybuffer[i], cm[pleft.x, pleft.y]);
+                // if (height_on_screen < ybuffer[i])
+                // {
+                //     ybuffer[i] = height_on_screen;
+                // }
+                pleft.x = pleft.x + dx;
+                pleft.y = pleft.y + dy;
+            }
+            //# Go to next line and increase step size when you are far away
+            z = z + dz;
+            dz = dz + 0.2_fx;
+        }
+    }
+
+
+protected:
+    static constexpr bool PROFILE = (FFR_PROFILE != 0);
+
+    //for backends that fill spans themselves instead of going through plot
+    auto profileSpan(uint32_t const pixels) -> void
+    {
+        if constexpr(PROFILE)
+        {
+            stats_.spans++;
+            stats_.pixels += pixels;
+        }
+    }
+
+    // Clip a triangle against all 6 homogeneous clip planes and triangulate result
+    // Returns number of output vertices (always a multiple of 3)
+    // Output contains triangulated vertices (every 3 vertices form a triangle)
+    static auto clip_triangle(math::vec4 v0, math::vec4 v1, math::vec4 v2, ffr::util::array<math::vec4, 27>& output) -> int
+    {
+        // Define the 6 clipping planes in homogeneous space
+        // For a vertex v = (x, y, z, w), the planes are:
+        // -w <= x <= w  =>  x + w >= 0 and -x + w >= 0
+        // -w <= y <= w  =>  y + w >= 0 and -y + w >= 0
+        // -w <= z <= w  =>  z + w >= 0 and -z + w >= 0
+
+        // Clip order: near, left, right, bottom, top, far
+        const math::vec4 planes[6] = {
+            math::vec4{ 0.0_fx,  0.0_fx,  1.0_fx,  1.0_fx},  // z + w >= 0  (near)
+            math::vec4{ 1.0_fx,  0.0_fx,  0.0_fx,  1.0_fx},  // x + w >= 0  (left)
+            math::vec4{-1.0_fx,  0.0_fx,  0.0_fx,  1.0_fx},  // -x + w >= 0 (right)
+            math::vec4{ 0.0_fx,  1.0_fx,  0.0_fx,  1.0_fx},  // y + w >= 0  (bottom)
+            math::vec4{ 0.0_fx, -1.0_fx,  0.0_fx,  1.0_fx},  // -y + w >= 0 (top)
+            math::vec4{ 0.0_fx,  0.0_fx, -1.0_fx,  1.0_fx}   // -z + w >= 0 (far)
+        };
+
+        // Working buffers for polygon clipping (ping-pong between them)
+        math::vec4 buffer1[9];  // Max vertices after clipping a triangle is 9
+        math::vec4 buffer2[9];
+
+        // Initialize with input triangle
+        buffer1[0].x = v0.x; buffer1[0].y = v0.y; buffer1[0].z = v0.z; buffer1[0].w = v0.w;
+        buffer1[1].x = v1.x; buffer1[1].y = v1.y; buffer1[1].z = v1.z; buffer1[1].w = v1.w;
+        buffer1[2].x = v2.x; buffer1[2].y = v2.y; buffer1[2].z = v2.z; buffer1[2].w = v2.w;
+
+        int vertCount = 3;
+
+        math::vec4* currentBuffer = buffer1;
+        math::vec4* nextBuffer = buffer2;
+
+        // Clip against each plane sequentially
+        for (int planeIdx = 0; planeIdx < 6; planeIdx++) {
+            const math::vec4& plane = planes[planeIdx];
+            int outCount = 0;
+
+            // Clip current polygon against this plane
+            for (int i = 0; i < vertCount; i++) {
+                const math::vec4& curr = currentBuffer[i];
+                const math::vec4& next = currentBuffer[(i + 1) % vertCount];
+
+                math::fixed32 currDist = (plane * curr);
+                math::fixed32 nextDist = (plane * next);
+
+                bool currInside = currDist >= 0.0_fx;
+                bool nextInside = nextDist >= 0.0_fx;
+
+                if (currInside) {
+                    nextBuffer[outCount++] = curr;
+                }
+
+                // If edge crosses the plane, compute intersection
+                if (currInside != nextInside) {
+                    math::fixed32 t = currDist * math::recip32(currDist - nextDist);
+                    nextBuffer[outCount++] = curr + ((next - curr)*t);
+                }
+            }
+
+            vertCount = outCount;
+
+            if (vertCount == 0) {
+                return 0;  // Triangle completely clipped
+            }
+
+            // Swap buffers
+            math::vec4* temp = currentBuffer;
+            currentBuffer = nextBuffer;
+            nextBuffer = temp;
+        }
+
+        // Triangulate the resulting polygon using fan triangulation
+        // Polygon vertices are in currentBuffer[0..vertCount-1]
+        int outIndex = 0;
+        for (int i = 1; i < vertCount - 1; i++) {
+            output[outIndex++] = currentBuffer[0];
+            output[outIndex++] = currentBuffer[i];
+            output[outIndex++] = currentBuffer[i + 1];
+        }
+
+        return outIndex;
+    }
+
+    //the products are kept wide, a screen-sized triangle's doubled area does
+    //not fit in fixed32
+    static auto frontFacing(math::vec2 v0, math::vec2 v1, math::vec2 v2) -> bool
+    {
+        return screen_area(v0, v1, v2) < math::fixed64{};
+    }
+
+    //doubled signed area in window coordinates, negative when counter
+    //clockwise with y up
+    static auto screen_area(math::vec2 v0, math::vec2 v1, math::vec2 v2) -> math::fixed64
+    {
+        return math::fixed64::product(v1.x - v0.x, v2.y - v0.y) - math::fixed64::product(v2.x - v0.x, v1.y - v0.y);
+    }
+
+    //sign of the determinant of the clip-space rows (x, y, w). with every w
+    //positive it has the sign of the ndc area, 1 counter clockwise and -1
+    //clockwise. 0 when a w is not positive, where the projection can flip
+    //the winding, or when the rounded determinant is too close to call,
+    //leaving the decision to the screen-space test after clipping
+    static auto clip_winding(math::vec4 const & v0, math::vec4 const & v1, math::vec4 const & v2) -> int8_t
+    {
+        if((v0.w <= 0.0_fx) || (v1.w <= 0.0_fx) || (v2.w <= 0.0_fx)) { return 0; }
+
+        //cofactors of row 0, exact in 32.32
+        int64_t const cx = (math::fixed64::product(v1.y, v2.w) - math::fixed64::product(v1.w, v2.y)).raw();
+        int64_t const cy = (math::fixed64::product(v1.w, v2.x) - math::fixed64::product(v1.x, v2.w)).raw();
+        int64_t const cw = (math::fixed64::product(v1.x, v2.y) - math::fixed64::product(v1.y, v2.x)).raw();
+
+        //drop low bits until the dot with row 0 fits in 64 bits. each dropped
+        //cofactor is off by less than one unit, so the result is off by less
+        //than |x0| + |y0| + |w0|
+        uint64_t const largest = std::max({magnitude(cx), magnitude(cy), magnitude(cw)});
+        int const shift = std::max(0, int(std::bit_width(largest)) - 30);
+        int64_t const det = (int64_t(v0.x.raw()) * (cx >> shift)) + (int64_t(v0.y.raw()) * (cy >> shift))
+                          + (int64_t(v0.w.raw()) * (cw >> shift));
+        int64_t const error = shift ? int64_t(magnitude(v0.x.raw()) + magnitude(v0.y.raw()) + magnitude(v0.w.raw())) : 0;
+
+        if(det > error) { return 1; }
+        if(det < -error) { return -1; }
+        return 0;
+    }
+
+    //the raster stage of every batch of projected points or triangles, the
+    //one virtual call between the pipeline and the backend. the default fills
+    //through the virtual plot, lineHorizontal and triangle. backends with a
+    //writer of their own override it to call rasterizeBatch with that writer
+    virtual auto rasterStage(VertexLanes<MAX_VERTS> const & post, ffr::util::array<uint16_t, MAX_VERTS> const & colors) -> void
+    {
+        VirtualWriter writer{*this};
+        rasterizeBatch(writer, post, colors);
+    }
+
+    //the draw type is settled here once per batch rather than per primitive
+    template<class WRITER>
+    auto rasterizeBatch(WRITER & writer, VertexLanes<MAX_VERTS> const & post,
+                        ffr::util::array<uint16_t, MAX_VERTS> const & colors) -> void
+    {
+        if(current_draw_type_ == DrawType::Points)
+        {
+            rasterizePoints(writer, post, colors);
+        }
+        else
+        {
+            rasterizeTriangles(writer, post, colors);
+        }
+    }
+
+    //one pixel per projected point, in the point's own colour
+    template<class WRITER>
+    auto rasterizePoints(WRITER & writer, VertexLanes<MAX_VERTS> const & post,
+                         ffr::util::array<uint16_t, MAX_VERTS> const & colors) -> void
+    {
+        uint64_t const t = profile_clock();
+        for(uint16_t i = 0; i < post.size; ++i)
+        {
+            writer.plot(static_cast<int16_t>(post.x[i]), static_cast<int16_t>(post.y[i]), colors[i]);
+        }
+        profile_stage(PipelineStage::Raster, t);
+    }
+
+    //cull, triage and fill a batch of projected triangles through WRITER,
+    //which is inlined into every loop here. a writer provides
+    //  plot(x, y, color)                        one pixel
+    //  span(x0, y, x1, color)                   inclusive, in either order
+    //  triangle(x0, y0, x1, y1, x2, y2, color)  the rest of the triage
+    //all three clip to the screen themselves
+    template<class WRITER>
+    auto rasterizeTriangles(WRITER & writer, VertexLanes<MAX_VERTS> const & post,
+                            ffr::util::array<uint16_t, MAX_VERTS> const & colors) -> void
+    {
+        for(uint16_t l = 0; l < post.size - 2; l = l + 3)
+        {
+            uint64_t t = profile_clock();
+            bool const front = survives_cull( {post.x[l], post.y[l]},
+                                              {post.x[l+1], post.y[l+1]},
+                                              {post.x[l+2], post.y[l+2]} );
+            t = profile_stage(PipelineStage::Cull, t);
+            if(front)
+            {
+                raster_triangle(writer,
+                                static_cast<int16_t>(post.x[l]), static_cast<int16_t>(post.y[l]),
+                                static_cast<int16_t>(post.x[l+1]), static_cast<int16_t>(post.y[l+1]),
+                                static_cast<int16_t>(post.x[l+2]), static_cast<int16_t>(post.y[l+2]),
+                                colors[l/3]);
+                profile_stage(PipelineStage::Raster, t);
+            }
+            else
+            {
+                profile_count(&PipelineStats::triangles_culled, 1);
+            }
+        }
+    }
+
+    //triage of a triangle snapped to pixels. triangle() fills, on each row,
+    //the span between its edges, which for a triangle spanning at most two
+    //rows is just the extent of the vertices on that row. those go straight
+    //to span(), matching it pixel for pixel. collinear triangles cover no
+    //area and are dropped, unless all three land on the same pixel
+    template<class WRITER>
+    auto raster_triangle(WRITER & writer, int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2,
+                         uint16_t color) -> void
+    {
+        int16_t const min_x = std::min({x0, x1, x2});
+        int16_t const max_x = std::max({x0, x1, x2});
+        int16_t const min_y = std::min({y0, y1, y2});
+        int16_t const max_y = std::max({y0, y1, y2});
+
+        if((min_x == max_x) && (min_y == max_y))
+        {
+            writer.plot(min_x, min_y, color);
+            profile_count(&PipelineStats::triangles_pixel, 1);
+            profile_count(&PipelineStats::triangles_rasterized, 1);
+            return;
+        }
+
+        if((int32_t(x1 - x0) * (y2 - y0)) == (int32_t(x2 - x0) * (y1 - y0)))
+        {
+            profile_count(&PipelineStats::triangles_degenerate, 1);
+            return;
+        }
+
+        profile_count(&PipelineStats::triangles_rasterized, 1);
+        if(((max_x - min_x) > 1) || ((max_y - min_y) > 1))
+        {
+            writer.triangle(x0, y0, x1, y1, x2, y2, color);
+            return;
+        }
+
+        profile_count(&PipelineStats::triangles_quad, 1);
+        for(int16_t y = min_y; y <= max_y; ++y)
+        {
+            int16_t const lo = std::min({(y0 == y) ? x0 : max_x, (y1 == y) ? x1 : max_x, (y2 == y) ? x2 : max_x});
+            int16_t const hi = std::max({(y0 == y) ? x0 : min_x, (y1 == y) ? x1 : min_x, (y2 == y) ? x2 : min_x});
+            writer.span(lo, y, hi, color);
+        }
+    }
+
+private:
+    //the default raster stage's writer, type-erased through the virtuals
+    class VirtualWriter
+    {
+    public:
+        Context & context;
+
+        auto plot(int16_t const x, int16_t const y, uint16_t const color) -> void
+        {
+            context.plot(uint16_t(x), uint16_t(y), color);
+        }
+
+        auto span(int16_t const x0, int16_t const y, int16_t const x1, uint16_t const color) -> void
+        {
+            context.lineHorizontal(x0, y, x1, color);
+        }
+
+        auto triangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color) -> void
+        {
+            context.triangle(x0, y0, x1, y1, x2, y2, color);
+        }
+    };
+
+    static auto magnitude(int64_t const v) -> uint64_t
+    {
+        return (v < 0) ? (uint64_t(0) - uint64_t(v)) : uint64_t(v);
+    }
+
+    int16_t view_width_ = 0;
+    int16_t view_height_ = 0;
+
+    DrawType current_draw_type_ = DrawType::Points;
+    BlendMode blend_mode_ = BlendMode::Opaque;
+    CullMode cull_mode_ = CullMode::Back;
+    FrontFace front_face_ = FrontFace::CounterClockwise;
+    VertexLayout vertex_layout_;
+
+    void const * vertex_pointer_ = nullptr;
+    uint16_t const * color_pointer_ = nullptr;
+
+    VertexLanes<MAX_VERTS> pre_clip_vert_buf_;
+    ffr::util::array<uint8_t, MAX_VERTS> pre_clip_outcode_buf_;
+    ffr::util::array<uint16_t, MAX_VERTS > pre_clip_color_buf_;
+    uint16_t pre_clip_color_buf_current_size_ = 0;
+
+    VertexLanes<MAX_VERTS> post_clip_vert_buf_;
+    ffr::util::array<uint16_t, MAX_VERTS> post_clip_color_buf_;
+    uint16_t post_clip_color_buf_current_size_ = 0;
+
+    VertexFunction* vertex_function_ = nullptr;
+
+    static constexpr uint8_t MATRIX_STACK_DEPTH = 8;
+    ffr::util::array<math::mat4, MATRIX_STACK_DEPTH> matrix_stack_;
+    uint8_t matrix_stack_top_ = 0;
+    math::mat4 projection_;
+    math::mat4 mvp_;
+    bool mvp_dirty_ = false;
+
+    [[no_unique_address]] ContextStats<MAX_VERTS> stats_;
+    TraceSink * trace_sink_ = nullptr;
+    OcclusionBuffer * occlusion_ = nullptr;
+
+    //outcode bits, one per clip plane the vertex is outside of
+    static constexpr uint8_t OUTCODE_LEFT   = 1 << 0;
+    static constexpr uint8_t OUTCODE_RIGHT  = 1 << 1;
+    static constexpr uint8_t OUTCODE_BOTTOM = 1 << 2;
+    static constexpr uint8_t OUTCODE_TOP    = 1 << 3;
+    static constexpr uint8_t OUTCODE_NEAR   = 1 << 4;
+    static constexpr uint8_t OUTCODE_FAR    = 1 << 5;
+
+    auto trace_draw(DrawType const dt, uint16_t const first, uint16_t const count, VertexLayout const & layout,
+                    void const * vertices, uint16_t const * colors, math::mat4 const & mvp,
+                    uint16_t const * indices = nullptr) -> void
+    {
+        TracedDraw draw;
+        draw.draw_type = dt;
+        draw.first = first;
+        draw.count = count;
+        draw.layout = layout;
+        draw.vertices = vertices;
+        draw.colors = colors;
+        draw.indices = indices;
+        draw.mvp = mvp;
+        draw.view_width = view_width_;
+        draw.view_height = view_height_;
+        draw.blend_mode = blend_mode_;
+        draw.cull_mode = cull_mode_;
+        draw.front_face = front_face_;
+        draw.vertex_function = (vertex_function_ != nullptr);
+        trace_sink_->traceDraw(draw);
+    }
+
+    static auto profile_clock() -> uint64_t
+    {
+        if constexpr(PROFILE) { return profileClock(); }
+        else { return 0; }
+    }
+
+    //adds the time since start to stage, returns now so stages can chain
+    auto profile_stage(PipelineStage const stage, uint64_t const start) -> uint64_t
+    {
+        if constexpr(PROFILE)
+        {
+            uint64_t const now = profileClock();
+            stats_.cycles[static_cast<uint8_t>(stage)] += now - start;
+            return now;
+        }
+        else
+        {
+            (void)stage;
+            (void)start;
+            return 0;
+        }
+    }
+
+    auto profile_count(uint32_t PipelineStats::* counter, uint32_t const n) -> void
+    {
+        if constexpr(PROFILE) { stats_.*counter += n; }
+        else { (void)counter; (void)n; }
+    }
+
+    auto vertex_pipeline() -> void
+    {
+        VertexLanes<MAX_VERTS> & pre = pre_clip_vert_buf_;
+        VertexLanes<MAX_VERTS> & post = post_clip_vert_buf_;
+
+        vertex_stage();
+        uint64_t t = profile_clock();
+
+        if(current_draw_type_ == DrawType::Points)
+        {
+            for(uint16_t i = 0; i < pre.size; ++i)
+            {
+                if(clip_point(pre.get(i)))
+                {
+                    post.push(pre.get(i));
+
+                    post_clip_color_buf_[post_clip_color_buf_current_size_] = pre_clip_color_buf_[i];
+                    post_clip_color_buf_current_size_++;
+                }
+            }
+            profile_stage(PipelineStage::Clip, t);
+        }
+        else if(current_draw_type_ == DrawType::Lines)
+        {
+
+        }
+        else    //DrawType::Triangles
+        {
+            //emit_triangle times the clipper itself
+            compute_outcodes(pre);
+            profile_stage(PipelineStage::Clip, t);
+
+            for(uint16_t i = 0; i < pre.size - 2; i = i + 3)
+            {
+                if(!emit_triangle(pre.get(i+0), pre.get(i+1), pre.get(i+2),
+                                  pre_clip_outcode_buf_[i+0], pre_clip_outcode_buf_[i+1], pre_clip_outcode_buf_[i+2],
+                                  pre_clip_color_buf_[i/3]))
+                {
+                    break;
+                }
+            }
+        }
+
+        finish_pipeline();
+    }
+
+    //runs the vertex function, or the matrix stack, over the pre-clip lanes
+    auto vertex_stage() -> void
+    {
+        VertexLanes<MAX_VERTS> & pre = pre_clip_vert_buf_;
+
+        profile_count(&PipelineStats::vertices_in, pre.size);
+        uint64_t const t = profile_clock();
+
+        //run vertex shader, mvp is composed once per draw rather than per vertex
+        math::mat4 const & mvp = modelViewProjection();
+        if(vertex_function_)
+        {
+            vertex_function_->setModelViewProjection(mvp);
+            for(uint16_t i = 0; i < pre.size; ++i)
+            {
+                math::vec4 v = pre.get(i);
+                vertex_function_[0](v);
+                pre.set(i, v);
+            }
+        }
+        else
+        {
+            transform_lanes(mvp, pre);
+        }
+        profile_stage(PipelineStage::Vertex, t);
+    }
+
+    //rasterizes and empties the post-clip lanes unless another needed
+    //vertices still fit, so one draw can emit more than MAX_VERTS. a
+    //triangle clipped into a full fan needs 21
+    auto make_room(uint16_t const needed = 21) -> void
+    {
+        if(post_clip_vert_buf_.size + needed <= post_clip_vert_buf_.capacity()) { return; }
+
+        finish_pipeline();
+        post_clip_vert_buf_.size = 0;
+        post_clip_color_buf_current_size_ = 0;
+    }
+
+    //indexed primitives whose vertices span more than the lanes hold. each
+    //vertex is fetched and transformed once per use
+    template<class T, uint8_t COMPONENTS>
+    auto unshared_elements(uint16_t first, uint16_t count, uint16_t const * elements) -> void
+    {
+        int32_t const scale = int32_t(1) << (16 - vertex_layout_.fraction_bits);
+        math::mat4 const & mvp = modelViewProjection();
+        if(vertex_function_) { vertex_function_->setModelViewProjection(mvp); }
+
+        profile_count(&PipelineStats::vertices_in, count);
+        assemble_elements(first, count, [&](uint16_t const i, uint8_t & oc) -> math::vec4 {
+            math::vec4 v = fetch_vertex<T, COMPONENTS>(vertex_source(vertex_pointer_, vertex_layout_, elements[i]), scale);
+            if(vertex_function_) { vertex_function_[0](v); }
+            else { v = mvp * v; }
+            oc = outcode(v);
+            return v;
+        });
+    }
+
+    //feeds count elements of an indexed draw to the clipper. element(i, oc)
+    //returns the clip-space position of element i and sets its outcode.
+    //once the post-clip lanes are full they are rasterized and emptied, so
+    //unlike drawArray no primitive is dropped
+    template<class ELEMENT>
+    auto assemble_elements(uint16_t const first, uint16_t const count, ELEMENT && element) -> void
+    {
+        if(current_draw_type_ == DrawType::Points)
+        {
+            VertexLanes<MAX_VERTS> & post = post_clip_vert_buf_;
+            for(uint16_t i = 0; i < count; ++i)
+            {
+                uint8_t oc = 0;
+                math::vec4 const v = element(i, oc);
+                if(clip_point(v))
+                {
+                    make_room(1);
+                    post.push(v);
+                    post_clip_color_buf_[post_clip_color_buf_current_size_] = color_pointer_[uint32_t(first) + i];
+                    post_clip_color_buf_current_size_++;
+                }
+            }
+            return;
+        }
+
+        for(uint16_t t = 0; t < count / 3; ++t)
+        {
+            uint8_t oc0 = 0;
+            uint8_t oc1 = 0;
+            uint8_t oc2 = 0;
+            math::vec4 const v0 = element(uint16_t(t * 3), oc0);
+            math::vec4 const v1 = element(uint16_t((t * 3) + 1), oc1);
+            math::vec4 const v2 = element(uint16_t((t * 3) + 2), oc2);
+            make_room();
+            if(!emit_triangle(v0, v1, v2, oc0, oc1, oc2, color_pointer_[(first / 3) + t]))
+            {
+                break;
+            }
+        }
+    }
+
+    //rebuild a mesh's screen-space cache if the mvp or viewport moved
+    auto update_mesh(Mesh<MAX_VERTS> & mesh, math::mat4 const & mvp) -> void
+    {
+        if(mesh.valid_ && (mvp == mesh.cached_mvp_)
+           && (mesh.cached_view_width_ == view_width_) && (mesh.cached_view_height_ == view_height_)
+           && (mesh.cached_cull_mode_ == cull_mode_) && (mesh.cached_front_face_ == front_face_))
+        {
+            return;
+        }
+
+        post_clip_vert_buf_.size = 0;
+        post_clip_color_buf_current_size_ = 0;
+
+        math::Containment containment = math::Containment::Intersecting;
+        if(mesh.bounds_ == Mesh<MAX_VERTS>::Bounds::Box)
+        {
+            containment = math::frustum::fromMatrix(mvp).classify(mesh.box_);
+        }
+        else if(mesh.bounds_ == Mesh<MAX_VERTS>::Bounds::Sphere)
+        {
+            containment = math::frustum::fromMatrix(mvp).classify(mesh.sphere_);
+        }
+        bool const clip = (containment != math::Containment::Inside);
+        profile_count(&PipelineStats::draws_culled, (containment == math::Containment::Outside) ? 1 : 0);
+        profile_count(&PipelineStats::draws_unclipped, clip ? 0 : 1);
+
+        if((mesh.draw_type_ != DrawType::Lines) && (containment != math::Containment::Outside))
+        {
+            with_vertex_layout(mesh.vertex_layout_, [&]<class T, uint8_t COMPONENTS>() {
+                fused_pipeline<T, COMPONENTS>(mesh.vertex_pointer_, mesh.vertex_layout_, mesh.color_pointer_,
+                                              mvp, mesh.first_, mesh.count_, clip);
+            });
+        }
+        project_post_clip();
+
+        mesh.screen_verts_.size = post_clip_vert_buf_.size;
+        for(uint16_t i = 0; i < post_clip_vert_buf_.size; ++i)
+        {
+            mesh.screen_verts_.set(i, post_clip_vert_buf_.get(i));
+        }
+        for(uint16_t i = 0; i < post_clip_color_buf_current_size_; ++i)
+        {
+            mesh.screen_colors_[i] = post_clip_color_buf_[i];
+        }
+
+        mesh.cached_mvp_ = mvp;
+        mesh.cached_view_width_ = view_width_;
+        mesh.cached_view_height_ = view_height_;
+        mesh.cached_cull_mode_ = cull_mode_;
+        mesh.cached_front_face_ = front_face_;
+        mesh.valid_ = true;
+    }
+
+    //occluder triangles are scaled from the viewport to occlusion cells
+    auto rasterize_occluder(VertexLanes<MAX_VERTS> const & post) -> void
+    {
+        math::fixed32 const sx = math::fixed32(int16_t(occlusion_->width())) / math::fixed32(view_width_);
+        math::fixed32 const sy = math::fixed32(int16_t(occlusion_->height())) / math::fixed32(view_height_);
+
+        occlusion_->beginOccluder();
+        for(uint16_t l = 0; l + 2 < post.size; l = l + 3)
+        {
+            if(survives_cull({post.x[l], post.y[l]}, {post.x[l+1], post.y[l+1]}, {post.x[l+2], post.y[l+2]}))
+            {
+                occlusion_->rasterize({post.x[l] * sx, post.y[l] * sy, post.z[l]},
+                                      {post.x[l+1] * sx, post.y[l+1] * sy, post.z[l+1]},
+                                      {post.x[l+2] * sx, post.y[l+2] * sy, post.z[l+2]});
+            }
+        }
+        occlusion_->endOccluder();
+    }
+
+    //projects the box's corners and tests the cells under their extent
+    //against its nearest depth. boxes reaching behind the near plane are
+    //never occluded
+    auto occluded_by(math::mat4 const & mvp, math::aabb const & box) const -> bool
+    {
+        math::fixed32 const half_w = math::fixed32(view_width_) * 0.5_fx;
+        math::fixed32 const half_h = math::fixed32(view_height_) * 0.5_fx;
+        math::fixed32 const sx = math::fixed32(int16_t(occlusion_->width())) / math::fixed32(view_width_);
+        math::fixed32 const sy = math::fixed32(int16_t(occlusion_->height())) / math::fixed32(view_height_);
+
+        math::fixed32 x0 = math::fixed32::fromRaw(INT32_MAX);
+        math::fixed32 y0 = math::fixed32::fromRaw(INT32_MAX);
+        math::fixed32 x1 = -math::fixed32::fromRaw(INT32_MAX);
+        math::fixed32 y1 = -math::fixed32::fromRaw(INT32_MAX);
+        math::fixed32 z0 = math::fixed32::fromRaw(INT32_MAX);
+        for(uint8_t corner = 0; corner < 8; ++corner)
+        {
+            math::vec4 const v = mvp * math::vec4{(corner & 1) ? box.max.x : box.min.x,
+                                                  (corner & 2) ? box.max.y : box.min.y,
+                                                  (corner & 4) ? box.max.z : box.min.z, 1.0_fx};
+            if((outcode(v) & OUTCODE_NEAR) || (v.w <= 0.0_fx)) { return false; }
+
+            math::recip32 const inv_w(v.w);
+            math::fixed32 const x = ((half_w * (v.x * inv_w)) + half_w) * sx;
+            math::fixed32 const y = (-(half_h * (v.y * inv_w)) + half_h) * sy;
+            math::fixed32 const z = (0.5_fx * (v.z * inv_w)) + 0.5_fx;
+            x0 = std::min(x0, x);
+            y0 = std::min(y0, y);
+            x1 = std::max(x1, x);
+            y1 = std::max(y1, y);
+            z0 = std::min(z0, z);
+        }
+
+        //whole cells touched by the extent
+        return occlusion_->occludes(x0.raw() >> 16, y0.raw() >> 16, (x1.raw() >> 16) + 1, (y1.raw() >> 16) + 1, z0);
+    }
+
+    //w divide, viewport and raster over whatever reached the post-clip lanes
+    auto finish_pipeline() -> void
+    {
+        project_post_clip();
+        rasterize(post_clip_vert_buf_, post_clip_color_buf_);
+    }
+
+    auto project_post_clip() -> void
+    {
+        VertexLanes<MAX_VERTS> & post = post_clip_vert_buf_;
+        profile_count(&PipelineStats::vertices_out, post.size);
+        uint64_t t = profile_clock();
+
+        //do w divide to yield ndc coords
+        w_divide_lanes(post);
+        t = profile_stage(PipelineStage::Divide, t);
+
+        //run ndc to window transform
+        viewport_lanes(post);
+        profile_stage(PipelineStage::Viewport, t);
+    }
+
+    //lines never reach the post-clip lanes, so there is nothing to raster
+    auto rasterize(VertexLanes<MAX_VERTS> const & post, ffr::util::array<uint16_t, MAX_VERTS> const & colors) -> void
+    {
+        if(current_draw_type_ != DrawType::Lines)
+        {
+            rasterStage(post, colors);
+        }
+    }
+
+    //true if a triangle of the given ndc winding is discarded
+    auto culls(bool const counter_clockwise) const -> bool
+    {
+        if(cull_mode_ == CullMode::None) { return false; }
+        bool const front = (counter_clockwise == (front_face_ == FrontFace::CounterClockwise));
+        return front == (cull_mode_ == CullMode::Front);
+    }
+
+    //the screen-space test. degenerate triangles cover nothing and never survive
+    auto survives_cull(math::vec2 v0, math::vec2 v1, math::vec2 v2) const -> bool
+    {
+        math::fixed64 const area = screen_area(v0, v1, v2);
+        return (area != math::fixed64{}) && !culls(area < math::fixed64{});
+    }
 
-            //# segment the line
-            math::fixed32 dx = static_cast<math::fixed32>(static_cast<int16_t>((pright.x - pleft.x) / math::fixed32(screen_width)));
-            math::fixed32 dy = static_cast<math::fixed32>(static_cast<int16_t>((pright.y - pleft.y) / math::fixed32(screen_width)));
+    //trivially reject, cull, pass through or clip one clip-space triangle into
+    //the post-clip lanes. false once the lanes are full
+    auto emit_triangle(math::vec4 const & v0, math::vec4 const & v1, math::vec4 const & v2,
+                       uint8_t oc0, uint8_t oc1, uint8_t oc2, uint16_t col) -> bool
+    {
+        VertexLanes<MAX_VERTS> & post = post_clip_vert_buf_;
+        profile_count(&PipelineStats::triangles_in, 1);
 
-            //# Raster line and draw a vertical line for each segment
-            for (math::fixed32 i=0.0_fx; i < math::fixed32(screen_width); i = i + 1.0_fx)
+        //all three outside the same plane, nothing survives clipping
+        if(oc0 & oc1 & oc2)
+        {
+            profile_count(&PipelineStats::triangles_rejected, 1);
+            return true;
+        }
+
+        //facing away before paying for the clipper and the divides. clipping
+        //keeps the winding, so undecided triangles are culled after projection
+        if(cull_mode_ != CullMode::None)
+        {
+            int8_t const winding = clip_winding(v0, v1, v2);
+            if((winding != 0) && culls(winding > 0))
             {
-                // auto height_on_screen = (height - hm[pleft.x, pleft.y]) / z * scale_height + horizon;
-                // //lineVertical(i, height_on_screen, ybuffer[i], cm[pleft.x, pleft.y]);
-                // if (height_on_screen < ybuffer[i])
-                // {
-                //     ybuffer[i] = height_on_screen;
-                // }
-                pleft.x = pleft.x + dx;
-                pleft.y = pleft.y + dy;
+                profile_count(&PipelineStats::triangles_culled, 1);
+                return true;
             }
-            //# Go to next line and increase step size when you are far away
-            z = z + dz;
-            dz = dz + 0.2_fx;
         }
-    }
 
+        if((oc0 | oc1 | oc2) == 0)
+        {
+            //all inside, clipping would return the triangle unchanged
+            if(post.size + 3 > post.capacity()) { return false; }
+
+            post.push(v0);
+            post.push(v1);
+            post.push(v2);
+            post_clip_color_buf_[post_clip_color_buf_current_size_] = col;
+            post_clip_color_buf_current_size_++;
+            return true;
+        }
 
-private:
-    int16_t view_width_ = 0;
-    int16_t view_height_ = 0;
+        profile_count(&PipelineStats::triangles_clipped, 1);
+        uint64_t const t = profile_clock();
+        ffr::util::array<math::vec4, 27> post_clip_verts;
+        uint16_t const post_clip_verts_size = clip_triangle(v0, v1, v2, post_clip_verts);
+        profile_stage(PipelineStage::Clip, t);
 
-    DrawType current_draw_type_ = DrawType::Points;
-    uint8_t current_vertex_size_ = 0;
+        if(post.size + post_clip_verts_size > post.capacity()) { return false; }
 
-    void* vertex_pointer_ = nullptr;
-    uint16_t* color_pointer_ = nullptr;
+        for(uint16_t ci = 0; ci < post_clip_verts_size/3; ci++)
+        {
+            post_clip_color_buf_[post_clip_color_buf_current_size_ + ci] = col;
+        }
+        post_clip_color_buf_current_size_ += post_clip_verts_size/3;
 
-    ffr::util::array<math::vec4, MAX_VERTS> pre_clip_vert_buf_;
-    uint16_t pre_clip_vert_buf_current_size_ = 0;
-    ffr::util::array<uint16_t, MAX_VERTS > pre_clip_color_buf_;
-    uint16_t pre_clip_color_buf_current_size_ = 0;
+        for(uint16_t vertIndex = 0; vertIndex < post_clip_verts_size; ++vertIndex)
+        {
+            post.push(post_clip_verts[vertIndex]);
+        }
+        return true;
+    }
 
-    ffr::util::array<math::vec4, MAX_VERTS> post_clip_vert_buf_;
-    uint16_t post_clip_vert_buf_current_size_ = 0;
-    ffr::util::array<uint16_t, MAX_VERTS> post_clip_color_buf_;
-    uint16_t post_clip_color_buf_current_size_ = 0;
+    //calls f.template operator()<T, COMPONENTS>() for the current vertex layout,
+    //so the per-vertex loops inside are specialised and branch-free
+    static auto with_vertex_layout(VertexLayout const & layout, auto f) -> void
+    {
+        bool const xyz = layout.components == 3;
+        switch(layout.type)
+        {
+        case VertexType::Fixed32:
+            xyz ? f.template operator()<math::fixed32, 3>() : f.template operator()<math::fixed32, 2>();
+            break;
+        case VertexType::Int16:
+            xyz ? f.template operator()<int16_t, 3>() : f.template operator()<int16_t, 2>();
+            break;
+        case VertexType::Int8:
+            xyz ? f.template operator()<int8_t, 3>() : f.template operator()<int8_t, 2>();
+            break;
+        }
+    }
 
-    VertexFunction* vertex_function_ = nullptr;
+    template<class T>
+    static auto to_fixed(T const & c, int32_t const scale) -> math::fixed32
+    {
+        if constexpr (sizeof(T) == sizeof(math::fixed32))
+        {
+            (void)scale;
+            return c;
+        }
+        else
+        {
+            return math::fixed32::fromRaw(int32_t(c) * scale);
+        }
+    }
 
-    auto vertex_pipeline() -> void
+    //interleaved layouts may put src at any byte offset, so copy the
+    //components out rather than dereference a possibly misaligned T *
+    template<class T, uint8_t COMPONENTS>
+    static auto fetch_vertex(uint8_t const * const src, int32_t const scale) -> math::vec4
+    {
+        T p[COMPONENTS];
+        std::memcpy(p, src, sizeof(p));
+        if constexpr (COMPONENTS == 3)
+        {
+            return {to_fixed(p[0], scale), to_fixed(p[1], scale), to_fixed(p[2], scale), 1.0_fx};
+        }
+        else
+        {
+            return {to_fixed(p[0], scale), to_fixed(p[1], scale), 0.0_fx, 1.0_fx};
+        }
+    }
+
+    static auto vertex_source(void const * vertices, VertexLayout const & layout, uint16_t first) -> uint8_t const *
     {
+        return static_cast<uint8_t const *>(vertices) + layout.offset + uint32_t(first) * layout.vertexStride();
+    }
 
-        ffr::util::array<math::vec4, 27> post_clip_verts;
-        uint16_t post_clip_verts_size = 0;
+    //copy count positions of type T starting at first into the pre-clip
+    //lanes, at most as many as they hold
+    template<class T, uint8_t COMPONENTS>
+    auto fetch_positions(uint16_t first, uint16_t count) -> void
+    {
+        count = std::min(count, pre_clip_vert_buf_.capacity());
+        VertexLanes<MAX_VERTS> & pre = pre_clip_vert_buf_;
+        uint16_t const stride = vertex_layout_.vertexStride();
+        int32_t const scale = int32_t(1) << (16 - vertex_layout_.fraction_bits);
+        uint8_t const * src = vertex_source(vertex_pointer_, vertex_layout_, first);
 
-        //run vertex shader
-        for(uint16_t i = 0; i < pre_clip_vert_buf_current_size_; ++i)
+        for(uint16_t i = 0; i < count; ++i)
         {
-            vertex_function_[0](pre_clip_vert_buf_[i]);
+            pre.set(i, fetch_vertex<T, COMPONENTS>(src, scale));
+            src += stride;
         }
+        pre.size = count;
+    }
+
+    //fetch, transform and outcode straight from the user's vertex memory; only
+    //visible points and surviving triangles are written to the post-clip lanes.
+    //without clip, triangles are known to be inside and pass straight through
+    template<class T, uint8_t COMPONENTS>
+    auto fused_pipeline(void const * vertices, VertexLayout const & layout, uint16_t const * colors,
+                        math::mat4 const & mvp, uint16_t first, uint16_t count, bool const clip) -> void
+    {
+        uint16_t const stride = layout.vertexStride();
+        int32_t const scale = int32_t(1) << (16 - layout.fraction_bits);
+        uint8_t const * src = vertex_source(vertices, layout, first);
+
+        auto next = [&]() -> math::vec4 {
+            math::vec4 const v = mvp * fetch_vertex<T, COMPONENTS>(src, scale);
+            src += stride;
+            return v;
+        };
+
+        //clipping inside the loop is timed on its own, the rest counts as vertex work
+        profile_count(&PipelineStats::vertices_in, count);
+        uint64_t const start = profile_clock();
+        uint64_t clip_start = 0;
+        if constexpr(PROFILE) { clip_start = stats_.stageCycles(PipelineStage::Clip); }
 
         if(current_draw_type_ == DrawType::Points)
         {
-            for(uint16_t i = 0; i < pre_clip_vert_buf_current_size_; ++i)
+            VertexLanes<MAX_VERTS> & post = post_clip_vert_buf_;
+            for(uint16_t i = 0; i < count && post.size < post.capacity(); ++i)
             {
-                if(clip_point(pre_clip_vert_buf_[i]))
+                math::vec4 const v = next();
+                if(clip_point(v))
                 {
-                    post_clip_vert_buf_[post_clip_vert_buf_current_size_] = pre_clip_vert_buf_[i];
-                    post_clip_vert_buf_current_size_++;
-
-                    post_clip_color_buf_[post_clip_color_buf_current_size_] = pre_clip_color_buf_[i];
+                    post.push(v);
+                    post_clip_color_buf_[post_clip_color_buf_current_size_] = colors[first + i];
                     post_clip_color_buf_current_size_++;
                 }
             }
-        }
-        else if(current_draw_type_ == DrawType::Lines)
-        {
-
         }
         else    //DrawType::Triangles
         {
-            for(uint16_t i = 0; i < pre_clip_vert_buf_current_size_ - 2; i = i + 3)
+            uint16_t const color_first = first / 3;
+            for(uint16_t t = 0; t < count / 3; ++t)
             {
-
-                auto col = pre_clip_color_buf_[i/3];
-
-                post_clip_verts_size = clip_triangle(pre_clip_vert_buf_[i+0],pre_clip_vert_buf_[i+1],pre_clip_vert_buf_[i+2],post_clip_verts);
-
-                for(uint16_t ci = 0; ci < post_clip_verts_size/3; ci++)
+                math::vec4 const v0 = next();
+                math::vec4 const v1 = next();
+                math::vec4 const v2 = next();
+                uint8_t const oc0 = clip ? outcode(v0) : 0;
+                uint8_t const oc1 = clip ? outcode(v1) : 0;
+                uint8_t const oc2 = clip ? outcode(v2) : 0;
+                if(!emit_triangle(v0, v1, v2, oc0, oc1, oc2, colors[color_first + t]))
                 {
-                    post_clip_color_buf_[post_clip_color_buf_current_size_ + ci] = col;
-                }
-                post_clip_color_buf_current_size_ += post_clip_verts_size/3;
-
-                for(uint16_t vertIndex = 0; vertIndex < post_clip_verts_size; ++vertIndex)
-                {
-                    //do w divide to yield ndc coords
-                    post_clip_verts[vertIndex].x = post_clip_verts[vertIndex].x / post_clip_verts[vertIndex].w;
-                    post_clip_verts[vertIndex].y = post_clip_verts[vertIndex].y / post_clip_verts[vertIndex].w;
-                    post_clip_verts[vertIndex].z = post_clip_verts[vertIndex].z / post_clip_verts[vertIndex].w;
-
-                    post_clip_vert_buf_[post_clip_vert_buf_current_size_ + vertIndex] = post_clip_verts[vertIndex];
+                    break;
                 }
-                post_clip_vert_buf_current_size_ += post_clip_verts_size;
-
             }
         }
 
-        //run ndc to window transform
-        for(uint16_t  i = 0; i < post_clip_vert_buf_current_size_; ++i)
+        if constexpr(PROFILE)
         {
-            post_clip_vert_buf_[i].x = ((math::fixed32(view_width_) * 0.5_fx) * post_clip_vert_buf_[i].x) + (math::fixed32(view_width_) * 0.5_fx);
-            post_clip_vert_buf_[i].y = -(((math::fixed32(view_height_) * 0.5_fx) * post_clip_vert_buf_[i].y)) + (math::fixed32(view_height_) * 0.5_fx);
-            post_clip_vert_buf_[i].z = (0.5_fx * post_clip_vert_buf_[i].z) + (0.5_fx);
+            uint64_t const clip_cycles = stats_.stageCycles(PipelineStage::Clip) - clip_start;
+            profile_stage(PipelineStage::Vertex, start + clip_cycles);
         }
-
-
-        //fnally, draw
-        if(current_draw_type_ == DrawType::Triangles)
+        else
         {
-            for(uint16_t l = 0; l < post_clip_vert_buf_current_size_ - 2; l = l + 3)
-            {
-                if(frontFacing( {post_clip_vert_buf_[l].x, post_clip_vert_buf_[l].y},
-                                {post_clip_vert_buf_[l+1].x,post_clip_vert_buf_[l+1].y},
-                                {post_clip_vert_buf_[l+2].x, post_clip_vert_buf_[l+2].y} ))
-                {
-                triangle(static_cast<int16_t>(post_clip_vert_buf_[l].x), static_cast<int16_t>(post_clip_vert_buf_[l].y),
-                        static_cast<int16_t>(post_clip_vert_buf_[l+1].x), static_cast<int16_t>(post_clip_vert_buf_[l+1].y),
-                        static_cast<int16_t>(post_clip_vert_buf_[l+2].x), static_cast<int16_t>(post_clip_vert_buf_[l+2].y),
-                         post_clip_color_buf_[l/3]);
-                }
+            (void)start;
+            (void)clip_start;
+        }
+    }
 
-            }
+    //v = m * v over every lane, each row summed wide and rounded once
+    auto transform_lanes(math::mat4 const & m, VertexLanes<MAX_VERTS> & v) -> void
+    {
+        for(uint16_t i = 0; i < v.size; ++i)
+        {
+            math::fixed32 const x = v.x[i];
+            math::fixed32 const y = v.y[i];
+            math::fixed32 const z = v.z[i];
+            math::fixed32 const w = v.w[i];
+
+            v.x[i] = math::fixed32(math::fixed64::product(m.m[0][0], x) + math::fixed64::product(m.m[1][0], y)
+                                   + math::fixed64::product(m.m[2][0], z) + math::fixed64::product(m.m[3][0], w));
+            v.y[i] = math::fixed32(math::fixed64::product(m.m[0][1], x) + math::fixed64::product(m.m[1][1], y)
+                                   + math::fixed64::product(m.m[2][1], z) + math::fixed64::product(m.m[3][1], w));
+            v.z[i] = math::fixed32(math::fixed64::product(m.m[0][2], x) + math::fixed64::product(m.m[1][2], y)
+                                   + math::fixed64::product(m.m[2][2], z) + math::fixed64::product(m.m[3][2], w));
+            v.w[i] = math::fixed32(math::fixed64::product(m.m[0][3], x) + math::fixed64::product(m.m[1][3], y)
+                                   + math::fixed64::product(m.m[2][3], z) + math::fixed64::product(m.m[3][3], w));
         }
+    }
 
+    //one bit per homogeneous clip plane, matching clip_triangle's inside tests
+    static auto outcode(math::vec4 const & v) -> uint8_t
+    {
+        math::fixed32 const nw = -v.w;
+        return static_cast<uint8_t>((OUTCODE_LEFT   * (v.x < nw))
+                                  | (OUTCODE_RIGHT  * (v.x > v.w))
+                                  | (OUTCODE_BOTTOM * (v.y < nw))
+                                  | (OUTCODE_TOP    * (v.y > v.w))
+                                  | (OUTCODE_NEAR   * (v.z < nw))
+                                  | (OUTCODE_FAR    * (v.z > v.w)));
+    }
 
+    auto compute_outcodes(VertexLanes<MAX_VERTS> const & v) -> void
+    {
+        for(uint16_t i = 0; i < v.size; ++i)
+        {
+            pre_clip_outcode_buf_[i] = outcode(v.get(i));
+        }
+    }
 
+    //one reciprocal per vertex shared by x, y and z
+    auto w_divide_lanes(VertexLanes<MAX_VERTS> & v) -> void
+    {
+        for(uint16_t i = 0; i < v.size; ++i)
+        {
+            math::recip32 const inv_w(v.w[i]);
+            v.x[i] = v.x[i] * inv_w;
+            v.y[i] = v.y[i] * inv_w;
+            v.z[i] = v.z[i] * inv_w;
+        }
+    }
 
+    auto viewport_lanes(VertexLanes<MAX_VERTS> & v) -> void
+    {
+        math::fixed32 const half_w = math::fixed32(view_width_) * 0.5_fx;
+        math::fixed32 const half_h = math::fixed32(view_height_) * 0.5_fx;
 
+        for(uint16_t i = 0; i < v.size; ++i)
+        {
+            v.x[i] = (half_w * v.x[i]) + half_w;
+            v.y[i] = -(half_h * v.y[i]) + half_h;
+            v.z[i] = (0.5_fx * v.z[i]) + (0.5_fx);
+        }
     }
 
-    //true if inside, false if out of bounds
+    //true if inside, false if out of bounds. the bounds are in clip space,
+    //-w to w, as points are w divided with the triangles
     auto clip_point(math::vec4 const & in) -> bool
     {
-        if ((in.x <= -1.0_fx ||
-             in.x >= 1.0_fx ||
-             in.y <= -1.0_fx ||
-             in.y >= 1.0_fx ||
-             in.z <= -1.0_fx ||
-             in.z >= 1.0_fx))
+        if ((in.x <= -in.w ||
+             in.x >= in.w ||
+             in.y <= -in.w ||
+             in.y >= in.w ||
+             in.z <= -in.w ||
+             in.z >= in.w))
         {
             return false;
         }
@@ -510,98 +2403,227 @@ private:
         }
     }
 
+};
+
 
-    // Clip a triangle against all 6 homogeneous clip planes and triangulate result
-    // Returns number of output vertices (always a multiple of 3)
-    // Output contains triangulated vertices (every 3 vertices form a triangle)
-    auto clip_triangle(math::vec4 v0, math::vec4 v1, math::vec4 v2, ffr::util::array<math::vec4, 27>& output) -> int
+enum class CommandOp : uint8_t
+{
+    SetVertexPointer,
+    SetColorPointer,
+    SetBlendMode,
+    SetCullMode,
+    SetFrontFace,
+    SetViewPort,
+    SetProjection,
+    LoadIdentity,
+    LoadMatrix,
+    MultMatrix,
+    PushMatrix,
+    PopMatrix,
+    DrawArray,
+    DrawElements,
+    DrawMesh
+};
+
+class Command
+{
+public:
+    CommandOp op = CommandOp::LoadIdentity;
+    DrawType draw_type = DrawType::Triangles;
+    uint16_t a = 0;             //first / width / matrix slot / blend, cull mode or front face
+    uint16_t b = 0;             //count / height
+    VertexLayout layout;
+    void const * ptr = nullptr; //vertices / colours / indices / mesh
+};
+
+//a recorded sequence of context state changes and draws, replayed with one
+//switch per command. matrices are copied into the buffer at record time,
+//vertex, colour and mesh data are referenced and must outlive it.
+//
+//execute() does not modify the buffer, so once recorded it can be replayed
+//from any thread, including several threads into separate contexts at once.
+//meshes update their cache when drawn, so one mesh should not be replayed by
+//two threads at the same time.
+template<uint8_t MAX_VERTS, uint16_t MAX_COMMANDS = 64, uint8_t MAX_MATRICES = 16>
+class CommandBuffer
+{
+public:
+    auto setVertexPointer(uint8_t size, void const * vp) -> void
     {
-        // Define the 6 clipping planes in homogeneous space
-        // For a vertex v = (x, y, z, w), the planes are:
-        // -w <= x <= w  =>  x + w >= 0 and -x + w >= 0
-        // -w <= y <= w  =>  y + w >= 0 and -y + w >= 0
-        // -w <= z <= w  =>  z + w >= 0 and -z + w >= 0
+        VertexLayout layout;
+        layout.components = size;
+        setVertexPointer(layout, vp);
+    }
 
-        // Clip order: near, left, right, bottom, top, far
-        const math::vec4 planes[6] = {
-            math::vec4{ 0.0_fx,  0.0_fx,  1.0_fx,  1.0_fx},  // z + w >= 0  (near)
-            math::vec4{ 1.0_fx,  0.0_fx,  0.0_fx,  1.0_fx},  // x + w >= 0  (left)
-            math::vec4{-1.0_fx,  0.0_fx,  0.0_fx,  1.0_fx},  // -x + w >= 0 (right)
-            math::vec4{ 0.0_fx,  1.0_fx,  0.0_fx,  1.0_fx},  // y + w >= 0  (bottom)
-            math::vec4{ 0.0_fx, -1.0_fx,  0.0_fx,  1.0_fx},  // -y + w >= 0 (top)
-            math::vec4{ 0.0_fx,  0.0_fx, -1.0_fx,  1.0_fx}   // -z + w >= 0 (far)
-        };
+    auto setVertexPointer(VertexLayout const & layout, void const * vp) -> void
+    {
+        Command * const c = record(CommandOp::SetVertexPointer);
+        if(c) { c->layout = layout; c->ptr = vp; }
+    }
 
-        // Working buffers for polygon clipping (ping-pong between them)
-        math::vec4 buffer1[9];  // Max vertices after clipping a triangle is 9
-        math::vec4 buffer2[9];
+    auto setColorPointer(uint16_t const * cp) -> void
+    {
+        Command * const c = record(CommandOp::SetColorPointer);
+        if(c) { c->ptr = cp; }
+    }
 
-        // Initialize with input triangle
-        buffer1[0].x = v0.x; buffer1[0].y = v0.y; buffer1[0].z = v0.z; buffer1[0].w = v0.w;
-        buffer1[1].x = v1.x; buffer1[1].y = v1.y; buffer1[1].z = v1.z; buffer1[1].w = v1.w;
-        buffer1[2].x = v2.x; buffer1[2].y = v2.y; buffer1[2].z = v2.z; buffer1[2].w = v2.w;
+    auto setBlendMode(BlendMode mode) -> void
+    {
+        Command * const c = record(CommandOp::SetBlendMode);
+        if(c) { c->a = static_cast<uint16_t>(mode); }
+    }
 
-        int vertCount = 3;
+    auto setCullMode(CullMode mode) -> void
+    {
+        Command * const c = record(CommandOp::SetCullMode);
+        if(c) { c->a = static_cast<uint16_t>(mode); }
+    }
 
-        math::vec4* currentBuffer = buffer1;
-        math::vec4* nextBuffer = buffer2;
+    auto setFrontFace(FrontFace face) -> void
+    {
+        Command * const c = record(CommandOp::SetFrontFace);
+        if(c) { c->a = static_cast<uint16_t>(face); }
+    }
 
-        // Clip against each plane sequentially
-        for (int planeIdx = 0; planeIdx < 6; planeIdx++) {
-            const math::vec4& plane = planes[planeIdx];
-            int outCount = 0;
+    auto setViewPort(int16_t w, int16_t h) -> void
+    {
+        Command * const c = record(CommandOp::SetViewPort);
+        if(c) { c->a = static_cast<uint16_t>(w); c->b = static_cast<uint16_t>(h); }
+    }
 
-            // Clip current polygon against this plane
-            for (int i = 0; i < vertCount; i++) {
-                const math::vec4& curr = currentBuffer[i];
-                const math::vec4& next = currentBuffer[(i + 1) % vertCount];
+    auto setProjection(math::mat4 const & pj) -> void
+    {
+        recordMatrix(CommandOp::SetProjection, pj);
+    }
 
-                math::fixed32 currDist = (plane * curr);
-                math::fixed32 nextDist = (plane * next);
+    auto loadIdentity() -> void
+    {
+        record(CommandOp::LoadIdentity);
+    }
 
-                bool currInside = currDist >= 0.0_fx;
-                bool nextInside = nextDist >= 0.0_fx;
+    auto loadMatrix(math::mat4 const & m) -> void
+    {
+        recordMatrix(CommandOp::LoadMatrix, m);
+    }
 
-                if (currInside) {
-                    nextBuffer[outCount++] = curr;
-                }
+    auto multMatrix(math::mat4 const & m) -> void
+    {
+        recordMatrix(CommandOp::MultMatrix, m);
+    }
 
-                // If edge crosses the plane, compute intersection
-                if (currInside != nextInside) {
-                    math::fixed32 t = currDist / (currDist - nextDist);
-                    nextBuffer[outCount++] = curr + ((next - curr)*t);
-                }
-            }
+    auto pushMatrix() -> void
+    {
+        record(CommandOp::PushMatrix);
+    }
 
-            vertCount = outCount;
+    auto popMatrix() -> void
+    {
+        record(CommandOp::PopMatrix);
+    }
 
-            if (vertCount == 0) {
-                return 0;  // Triangle completely clipped
-            }
+    auto drawArray(DrawType dt, uint16_t first, uint16_t count) -> void
+    {
+        Command * const c = record(CommandOp::DrawArray);
+        if(c) { c->draw_type = dt; c->a = first; c->b = count; }
+    }
 
-            // Swap buffers
-            math::vec4* temp = currentBuffer;
-            currentBuffer = nextBuffer;
-            nextBuffer = temp;
-        }
+    //the indices are referenced, like vertex and colour data
+    auto drawElements(DrawType dt, uint16_t first, uint16_t count, uint16_t const * indices) -> void
+    {
+        Command * const c = record(CommandOp::DrawElements);
+        if(c) { c->draw_type = dt; c->a = first; c->b = count; c->ptr = indices; }
+    }
 
-        // Triangulate the resulting polygon using fan triangulation
-        // Polygon vertices are in currentBuffer[0..vertCount-1]
-        int outIndex = 0;
-        for (int i = 1; i < vertCount - 1; i++) {
-            output[outIndex++] = currentBuffer[0];
-            output[outIndex++] = currentBuffer[i];
-            output[outIndex++] = currentBuffer[i + 1];
-        }
+    auto drawMesh(Mesh<MAX_VERTS> & mesh) -> void
+    {
+        Command * const c = record(CommandOp::DrawMesh);
+        if(c) { c->ptr = &mesh; }
+    }
 
-        return outIndex;
+    //drop everything recorded so far
+    auto reset() -> void
+    {
+        command_count_ = 0;
+        matrix_count_ = 0;
+        overflowed_ = false;
+    }
+
+    auto size() const -> uint16_t
+    {
+        return command_count_;
+    }
+
+    //true if a command or matrix was dropped because the buffer was full
+    auto overflowed() const -> bool
+    {
+        return overflowed_;
+    }
+
+    auto execute(Context<MAX_VERTS> & ctx) const -> void
+    {
+        for(uint16_t i = 0; i < command_count_; ++i)
+        {
+            Command const & c = commands_[i];
+            switch(c.op)
+            {
+            case CommandOp::SetVertexPointer: ctx.setVertexPointer(c.layout, c.ptr); break;
+            case CommandOp::SetColorPointer: ctx.setColorPointer(static_cast<uint16_t const *>(c.ptr)); break;
+            case CommandOp::SetBlendMode: ctx.setBlendMode(static_cast<BlendMode>(c.a)); break;
+            case CommandOp::SetCullMode: ctx.setCullMode(static_cast<CullMode>(c.a)); break;
+            case CommandOp::SetFrontFace: ctx.setFrontFace(static_cast<FrontFace>(c.a)); break;
+            case CommandOp::SetViewPort: ctx.setViewPort(static_cast<int16_t>(c.a), static_cast<int16_t>(c.b)); break;
+            case CommandOp::SetProjection: ctx.setProjection(matrices_[c.a]); break;
+            case CommandOp::LoadIdentity: ctx.loadIdentity(); break;
+            case CommandOp::LoadMatrix: ctx.loadMatrix(matrices_[c.a]); break;
+            case CommandOp::MultMatrix: ctx.multMatrix(matrices_[c.a]); break;
+            case CommandOp::PushMatrix: ctx.pushMatrix(); break;
+            case CommandOp::PopMatrix: ctx.popMatrix(); break;
+            case CommandOp::DrawArray: ctx.drawArray(c.draw_type, c.a, c.b); break;
+            case CommandOp::DrawElements: ctx.drawElements(c.draw_type, c.a, c.b, static_cast<uint16_t const *>(c.ptr)); break;
+            case CommandOp::DrawMesh:
+                //the mesh cache is the only state a replay touches
+                ctx.drawMesh(*static_cast<Mesh<MAX_VERTS> *>(const_cast<void *>(c.ptr)));
+                break;
+            }
+        }
     }
 
-    auto frontFacing(math::vec2 v0, math::vec2 v1, math::vec2 v2) -> bool
+private:
+    ffr::util::array<Command, MAX_COMMANDS> commands_;
+    uint16_t command_count_ = 0;
+    ffr::util::array<math::mat4, MAX_MATRICES> matrices_;
+    uint8_t matrix_count_ = 0;
+    bool overflowed_ = false;
+
+    auto record(CommandOp op) -> Command *
     {
-        return ((v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y)) < 0.0_fx;
+        if(command_count_ >= MAX_COMMANDS)
+        {
+            overflowed_ = true;
+            return nullptr;
+        }
+        Command & c = commands_[command_count_];
+        c = Command{};
+        c.op = op;
+        command_count_++;
+        return &c;
     }
 
+    auto recordMatrix(CommandOp op, math::mat4 const & m) -> void
+    {
+        if(matrix_count_ >= MAX_MATRICES)
+        {
+            overflowed_ = true;
+            return;
+        }
+        Command * const c = record(op);
+        if(c)
+        {
+            matrices_[matrix_count_] = m;
+            c->a = matrix_count_;
+            matrix_count_++;
+        }
+    }
 };
 
 
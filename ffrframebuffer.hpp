@@ -0,0 +1,578 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+#include "ffr.hpp"
+
+namespace ffr
+{
+
+//pixel rectangle, x1 and y1 exclusive
+class DirtyRect
+{
+public:
+    uint16_t x0 = 0;
+    uint16_t y0 = 0;
+    uint16_t x1 = 0;
+    uint16_t y1 = 0;
+
+    auto empty() const -> bool
+    {
+        return (x0 >= x1) || (y0 >= y1);
+    }
+};
+
+//receives finished 15-bit frames. runs on the presenter thread when a
+//FramebufferContext presents asynchronously, so it must not touch the
+//context or anything the render thread uses.
+//only pixels inside dirty differ from the previously presented frame
+class Presenter
+{
+public:
+    virtual ~Presenter() = default;
+
+    virtual auto presentFrame(uint16_t const * pixels, uint16_t width, uint16_t height, DirtyRect const & dirty) -> void = 0;
+};
+
+namespace
+{
+
+//fills count pixels with one colour, a vector register at a time where
+//the target has them
+template<typename PIXEL>
+inline auto fillPixels(PIXEL * dst, PIXEL const color, uint32_t count) -> void
+{
+    if constexpr(sizeof(PIXEL) == 1)
+    {
+        std::memset(dst, color, count);
+        return;
+    }
+
+    uint32_t i = 0;
+
+#if defined(__AVX2__)
+    __m256i const wide = _mm256_set1_epi16(int16_t(color));
+    for(; i + 16 <= count; i += 16)
+    {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), wide);
+    }
+#endif
+
+#if defined(__SSE2__)
+    __m128i const narrow = _mm_set1_epi16(int16_t(color));
+    for(; i + 8 <= count; i += 8)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), narrow);
+    }
+#endif
+
+    for(; i < count; ++i)
+    {
+        dst[i] = color;
+    }
+}
+
+//blends one colour into count 555 pixels, four per 64 bit word
+template<BlendMode MODE>
+inline auto blendSpan(uint16_t * dst, uint16_t const color, uint32_t count) -> void
+{
+    uint64_t const src = uint64_t(color) * 0x0001000100010001ull;
+    uint32_t i = 0;
+
+    for(; i + 4 <= count; i += 4)
+    {
+        uint64_t d;
+        std::memcpy(&d, dst + i, sizeof(d));
+        d = BlendPixels555<MODE>(d, src);
+        std::memcpy(dst + i, &d, sizeof(d));
+    }
+
+    for(; i < count; ++i)
+    {
+        dst[i] = uint16_t(BlendPixels555<MODE>(dst[i], color));
+    }
+}
+
+}
+
+
+//blend policies of a FramebufferContext. RuntimeBlend follows
+//setBlendMode and picks the span loop once per primitive, FixedBlend
+//compiles a single mode in and ignores setBlendMode
+class RuntimeBlend
+{
+};
+
+template<BlendMode MODE>
+class FixedBlend
+{
+public:
+    static constexpr BlendMode mode = MODE;
+};
+
+
+//bounded single-producer single-consumer queue of frame indices. push and
+//pop never block or lock; waitNotEmpty parks the consumer on the atomic
+template<uint8_t CAPACITY>
+class FrameQueue
+{
+public:
+    auto push(uint8_t const frame) -> bool
+    {
+        uint32_t const tail = tail_.load(std::memory_order_relaxed);
+        if(tail - head_.load(std::memory_order_acquire) == CAPACITY) { return false; }
+
+        slots_[tail % CAPACITY] = frame;
+        tail_.store(tail + 1, std::memory_order_release);
+        tail_.notify_one();
+        return true;
+    }
+
+    auto pop(uint8_t & frame) -> bool
+    {
+        uint32_t const head = head_.load(std::memory_order_relaxed);
+        if(head == tail_.load(std::memory_order_acquire)) { return false; }
+
+        frame = slots_[head % CAPACITY];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    auto waitNotEmpty() const -> void
+    {
+        uint32_t const head = head_.load(std::memory_order_relaxed);
+        tail_.wait(head, std::memory_order_acquire);
+    }
+
+private:
+    std::atomic<uint32_t> head_ = 0;
+    std::atomic<uint32_t> tail_ = 0;
+    uint8_t slots_[CAPACITY] = {};
+};
+
+
+//a context that rasterizes into FRAMES framebuffers of WIDTH x HEIGHT.
+//PIXEL is uint16_t for 555 colour, or uint8_t for palette indices, which
+//halves the bandwidth of rasterizing and clearing, but always draws
+//opaque since indices cannot be blended. indexed frames are
+//expanded through the palette they were presented with, on the presenter
+//side and only inside the changed area, so presenters always see 555.
+//with a presenter thread running, present() hands the finished frame over
+//and rendering continues into the next free buffer while the presenter
+//converts and shows the old one. present() only waits when every buffer is
+//still queued, which bounds the latency to FRAMES - 1 frames.
+//every buffer keeps per scanline spans of what was drawn into it since its
+//last clear, so clear() only wipes those spans and the presenter is told
+//the bounds of what changed since the last frame it showed. anything
+//written through pixels() needs an invalidate().
+//the raster stage runs on a writer specialised on the pixel type and blend
+//mode, with the dirty tracking inlined. the only runtime dispatch is the
+//virtual rasterStage call and, with RuntimeBlend, one switch on the mode,
+//both once per batch. plot, line, lineHorizontal and triangle called
+//directly go through the same writer, dispatched once per call
+template<uint8_t MAX_VERTS, uint16_t WIDTH, uint16_t HEIGHT, uint8_t FRAMES = 2, typename PIXEL = uint16_t,
+         class BLEND = RuntimeBlend>
+class FramebufferContext : public Context<MAX_VERTS>
+{
+    static_assert(FRAMES >= 1 && FRAMES <= 4, "FramebufferContext supports 1 to 4 frames");
+    static_assert(sizeof(PIXEL) == 1 || sizeof(PIXEL) == 2, "FramebufferContext pixels are uint8_t indices or uint16_t 555");
+
+    static constexpr bool PALETTED = (sizeof(PIXEL) == 1);
+    static constexpr bool FIXED_BLEND = !std::is_same_v<BLEND, RuntimeBlend>;
+
+public:
+    FramebufferContext()
+    {
+        for(uint8_t f = 1; f < FRAMES; ++f)
+        {
+            free_.push(f);
+        }
+    }
+
+    ~FramebufferContext() override
+    {
+        stopPresenterThread();
+    }
+
+    auto plot(uint16_t x, uint16_t y, uint16_t color) -> void override
+    {
+        withWriter([&](auto & writer) {
+            writer.plot(int16_t(x), int16_t(y), color);
+        });
+    }
+
+    auto line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) -> void override
+    {
+        withWriter([&](auto & writer) {
+            rasterizeLine(x0, y0, x1, y1, [&](int16_t x, int16_t y) {
+                writer.plot(x, y, color);
+            });
+        });
+    }
+
+    //spans are filled directly instead of plotting every pixel through line()
+    auto lineHorizontal(int16_t x0, int16_t y0, int16_t x1, uint16_t color) -> void override
+    {
+        withWriter([&](auto & writer) {
+            writer.span(x0, y0, x1, color);
+        });
+    }
+
+    auto triangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color) -> void override
+    {
+        withWriter([&](auto & writer) {
+            writer.triangle(x0, y0, x1, y1, x2, y2, color);
+        });
+    }
+
+    auto clear() -> void override
+    {
+        PIXEL * const px = frames_[back_];
+        Span * const dirty = dirty_[back_];
+        for(uint16_t y = 0; y < HEIGHT; ++y)
+        {
+            if(dirty[y].empty()) { continue; }
+
+            fillPixels(px + (y * WIDTH) + dirty[y].x0, clear_color_, dirty[y].x1 - dirty[y].x0);
+            dirty[y] = Span{};
+        }
+    }
+
+    auto present() -> void override
+    {
+        if(!presenter_) { return; }
+
+        //the screen changes wherever this frame or the last one drew
+        DirtyRect damage{WIDTH, HEIGHT, 0, 0};
+        Span const * const dirty = dirty_[back_];
+        for(uint16_t y = 0; y < HEIGHT; ++y)
+        {
+            Span row = shown_[y];
+            row.add(dirty[y].x0, dirty[y].x1);
+            shown_[y] = dirty[y];
+            if(row.empty()) { continue; }
+
+            damage.x0 = (row.x0 < damage.x0) ? row.x0 : damage.x0;
+            damage.x1 = (row.x1 > damage.x1) ? row.x1 : damage.x1;
+            damage.y0 = (y < damage.y0) ? y : damage.y0;
+            damage.y1 = y + 1;
+        }
+        if(damage.empty()) { damage = DirtyRect{}; }
+
+        damage_[back_] = damage;
+        if constexpr(PALETTED)
+        {
+            std::memcpy(frame_palettes_[back_], palette_, sizeof(palette_));
+        }
+
+        if(!presenter_thread_.joinable())
+        {
+            show(back_);
+            return;
+        }
+
+        ready_.push(back_);
+        back_ = acquire();
+    }
+
+    //every buffer is repainted on its next clear and the next present
+    //reports the whole screen
+    auto setClearColor(uint16_t color) -> void
+    {
+        if(PIXEL(color) == clear_color_) { return; }
+
+        clear_color_ = PIXEL(color);
+        for(uint8_t f = 0; f < FRAMES; ++f)
+        {
+            invalidate(f);
+        }
+        invalidate_shown();
+    }
+
+    //palette entries for indexed frames. changes apply from the next
+    //present, which then reports the whole screen
+    auto setPalette(uint16_t const * colors, uint8_t first, uint16_t count) -> void
+    {
+        static_assert(PALETTED, "setPalette needs a uint8_t FramebufferContext");
+
+        for(uint16_t i = 0; (i < count) && (first + i < 256); ++i)
+        {
+            palette_[first + i] = colors[i];
+        }
+        invalidate_shown();
+    }
+
+    //palette from packed r,g,b byte triplets
+    auto setPaletteRGB888(uint8_t const * rgb, uint8_t first, uint16_t count) -> void
+    {
+        uint16_t colors[256];
+        count = (first + count > 256) ? (256 - first) : count;
+        ConvertRGB888to555(rgb, colors, count);
+        setPalette(colors, first, count);
+    }
+
+    //marks the whole back buffer as drawn, after writing through pixels()
+    auto invalidate() -> void
+    {
+        invalidate(back_);
+    }
+
+    //present synchronously on the calling thread
+    auto setPresenter(Presenter * p) -> void
+    {
+        stopPresenterThread();
+        presenter_ = p;
+    }
+
+    //present on a worker thread. needs at least two frames, with one frame
+    //it falls back to presenting synchronously
+    auto startPresenterThread(Presenter * p) -> void
+    {
+        setPresenter(p);
+        if((!p) || (FRAMES < 2)) { return; }
+
+        presenter_thread_ = std::thread([this]() { presenter_loop(); });
+    }
+
+    //finishes every queued frame, then joins the worker
+    auto stopPresenterThread() -> void
+    {
+        if(!presenter_thread_.joinable()) { return; }
+
+        ready_.push(STOP);
+        presenter_thread_.join();
+    }
+
+    //the buffer currently being rendered
+    auto pixels() -> PIXEL *
+    {
+        return frames_[back_];
+    }
+
+    auto pixels() const -> PIXEL const *
+    {
+        return frames_[back_];
+    }
+
+protected:
+    //the blend mode is fixed for a whole batch, so it is resolved here once
+    //and the cull, triage and span loops run on the specialised writer
+    auto rasterStage(VertexLanes<MAX_VERTS> const & post, ffr::util::array<uint16_t, MAX_VERTS> const & colors) -> void override
+    {
+        withWriter([&](auto & writer) {
+            this->rasterizeBatch(writer, post, colors);
+        });
+    }
+
+    //calls f(writer) with a writer on the back buffer for the blend mode
+    //primitives are drawn with, so the loops inside are specialised on it
+    auto withWriter(auto f) -> void
+    {
+        if constexpr(PALETTED)
+        {
+            if constexpr(FIXED_BLEND)
+            {
+                static_assert(BLEND::mode == BlendMode::Opaque, "indexed FramebufferContexts cannot blend");
+            }
+            with_mode<BlendMode::Opaque>(f);
+        }
+        else if constexpr(FIXED_BLEND)
+        {
+            with_mode<BLEND::mode>(f);
+        }
+        else
+        {
+            switch(this->blendMode())
+            {
+            case BlendMode::Opaque: with_mode<BlendMode::Opaque>(f); break;
+            case BlendMode::Add: with_mode<BlendMode::Add>(f); break;
+            case BlendMode::Subtract: with_mode<BlendMode::Subtract>(f); break;
+            case BlendMode::Average: with_mode<BlendMode::Average>(f); break;
+            }
+        }
+    }
+
+private:
+    static constexpr uint8_t STOP = 0xFF;
+
+    //touched pixels of one scanline, x1 exclusive
+    class Span
+    {
+    public:
+        uint16_t x0 = WIDTH;
+        uint16_t x1 = 0;
+
+        auto empty() const -> bool
+        {
+            return x0 >= x1;
+        }
+
+        auto add(uint16_t const from, uint16_t const to) -> void
+        {
+            x0 = (from < x0) ? from : x0;
+            x1 = (to > x1) ? to : x1;
+        }
+    };
+
+    PIXEL frames_[FRAMES][uint32_t(WIDTH) * HEIGHT] = {};
+    uint8_t back_ = 0;
+    PIXEL clear_color_ = 0;
+
+    //indexed frames only: the palette being built, the palette each buffer
+    //was presented with, and the 555 image the presenter side expands into
+    uint32_t palette_[PALETTED ? 256 : 1] = {};
+    uint32_t frame_palettes_[FRAMES][PALETTED ? 256 : 1] = {};
+    uint16_t expanded_[PALETTED ? uint32_t(WIDTH) * HEIGHT : 1] = {};
+
+    //drawn since each buffer's last clear, and drawn in the last presented frame
+    Span dirty_[FRAMES][HEIGHT] = {};
+    Span shown_[HEIGHT] = {};
+    DirtyRect damage_[FRAMES] = {};
+
+    //frames waiting to be shown, and frames free to render into. one spare
+    //slot in ready_ so the stop marker always fits
+    FrameQueue<FRAMES + 1> ready_;
+    FrameQueue<FRAMES> free_;
+
+    Presenter * presenter_ = nullptr;
+    std::thread presenter_thread_;
+
+    //the raster stage's writer, bound to one buffer and one blend mode
+    template<BlendMode MODE>
+    class Writer
+    {
+    public:
+        FramebufferContext & context;
+        PIXEL * const px;
+        Span * const dirty;
+
+        auto plot(int16_t const x, int16_t const y, uint16_t const color) -> void
+        {
+            if((x < 0) || (x >= WIDTH) || (y < 0) || (y >= HEIGHT)) { return; }
+
+            draw_span<MODE>(px + (y * WIDTH) + x, color, 1);
+            dirty[y].add(uint16_t(x), uint16_t(x + 1));
+            context.profileSpan(1);
+        }
+
+        //clips the inclusive span x0..x1, in either order, to the screen and fills it
+        auto span(int16_t x0, int16_t const y, int16_t x1, uint16_t const color) -> void
+        {
+            if((y < 0) || (y >= HEIGHT)) { return; }
+            if(x0 > x1)
+            {
+                int16_t const tmp = x0;
+                x0 = x1;
+                x1 = tmp;
+            }
+            if(x0 < 0) { x0 = 0; }
+            if(x1 >= WIDTH) { x1 = WIDTH - 1; }
+            if(x0 > x1) { return; }
+
+            draw_span<MODE>(px + (y * WIDTH) + x0, color, uint32_t(x1 - x0) + 1);
+            dirty[y].add(uint16_t(x0), uint16_t(x1 + 1));
+            context.profileSpan(uint32_t(x1 - x0) + 1);
+        }
+
+        auto triangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color) -> void
+        {
+            rasterizeTriangle(x0, y0, x1, y1, x2, y2, [&](int16_t xa, int16_t y, int16_t xb) {
+                span(xa, y, xb, color);
+            });
+        }
+    };
+
+    auto invalidate(uint8_t const f) -> void
+    {
+        for(uint16_t y = 0; y < HEIGHT; ++y)
+        {
+            dirty_[f][y] = Span{0, WIDTH};
+        }
+    }
+
+    template<BlendMode MODE>
+    auto with_mode(auto & f) -> void
+    {
+        Writer<MODE> writer{*this, frames_[back_], dirty_[back_]};
+        f(writer);
+    }
+
+    template<BlendMode MODE>
+    static auto draw_span(PIXEL * dst, uint16_t const color, uint32_t const count) -> void
+    {
+        if constexpr(PALETTED || (MODE == BlendMode::Opaque))
+        {
+            fillPixels(dst, PIXEL(color), count);
+        }
+        else
+        {
+            blendSpan<MODE>(dst, color, count);
+        }
+    }
+
+    auto invalidate_shown() -> void
+    {
+        for(uint16_t y = 0; y < HEIGHT; ++y)
+        {
+            shown_[y] = Span{0, WIDTH};
+        }
+    }
+
+    //the expanded image persists between frames, so only the damage needs
+    //looking up
+    auto show(uint8_t const f) -> void
+    {
+        DirtyRect const & damage = damage_[f];
+        if constexpr(PALETTED)
+        {
+            for(uint16_t y = damage.y0; y < damage.y1; ++y)
+            {
+                uint32_t const row = (y * WIDTH) + damage.x0;
+                ExpandPalette(frames_[f] + row, frame_palettes_[f], expanded_ + row, damage.x1 - damage.x0);
+            }
+            presenter_->presentFrame(expanded_, WIDTH, HEIGHT, damage);
+        }
+        else
+        {
+            presenter_->presentFrame(frames_[f], WIDTH, HEIGHT, damage);
+        }
+    }
+
+    auto acquire() -> uint8_t
+    {
+        uint8_t f = 0;
+        while(!free_.pop(f))
+        {
+            free_.waitNotEmpty();
+        }
+        return f;
+    }
+
+    auto presenter_loop() -> void
+    {
+        for(;;)
+        {
+            uint8_t f = 0;
+            while(!ready_.pop(f))
+            {
+                ready_.waitNotEmpty();
+            }
+
+            if(f == STOP) { return; }
+
+            show(f);
+            free_.push(f);
+        }
+    }
+};
+
+//8 bit indexed render target with a 256 entry 555 palette. colours passed
+//to drawing calls and setClearColor are palette indices
+template<uint8_t MAX_VERTS, uint16_t WIDTH, uint16_t HEIGHT, uint8_t FRAMES = 2>
+using PalettedContext = FramebufferContext<MAX_VERTS, WIDTH, HEIGHT, FRAMES, uint8_t>;
+
+}
@@ -0,0 +1,654 @@
+#include "ffr.hpp"
+#include "ffrframebuffer.hpp"
+#include "ffrmesh.hpp"
+#include "ffrtrace.hpp"
+#include "util.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// renders a fixed set of scenes offscreen and compares them with the
+// reference images in the golden directory.
+//
+// usage: ffrgolden [--update] [--tolerance N] [--filter TEXT] [--golden DIR] [--out DIR] [--trace DIR]
+//   --update       rewrite the references from the current renderer
+//   --tolerance N  allow every channel to differ by up to N of 31, overriding
+//                  the per-scene tolerance
+//   --filter TEXT  only scenes whose name contains TEXT
+//   --golden DIR   reference directory, defaults to the one in the source tree
+//   --out DIR      where actual/expected/diff PPMs of failing scenes go
+//   --trace DIR    also capture each scene's draws as <scene>.ffrtrace, for
+//                  ffrmicrobench --trace
+//
+// references are run-length encoded 555: a "FFR555 <w> <h>\n" header, then
+// little endian (count, colour) uint16_t pairs
+
+#if !defined(FFR_GOLDEN_DIR)
+#define FFR_GOLDEN_DIR "golden"
+#endif
+
+namespace
+{
+
+constexpr uint16_t WIDTH = 240;
+constexpr uint16_t HEIGHT = 160;
+constexpr uint32_t PIXELS = uint32_t(WIDTH) * HEIGHT;
+constexpr uint32_t MAX_REPORTED = 8;
+
+using GoldenContext = ffr::FramebufferContext<255, WIDTH, HEIGHT, 1>;
+using Image = std::vector<uint16_t>;
+
+class Options
+{
+public:
+    bool update = false;
+    int tolerance = -1;
+    char const * filter = nullptr;
+    std::string golden = FFR_GOLDEN_DIR;
+    std::string out = ".";
+    char const * trace = nullptr;
+};
+
+class Scene
+{
+public:
+    char const * name;
+    int tolerance;          // per channel, in 5 bit steps. 0 is exact
+    void (*render)(GoldenContext & c);
+};
+
+Options options;
+
+auto const cube = ffr::util::createCube(1.0_fx, 1.0_fx, 1.0_fx);
+
+uint16_t const cube_colors[12] =
+{
+    ffr::Convert888to555(255,255,255), ffr::Convert888to555(200,200,200),
+    ffr::Convert888to555(255,0,0), ffr::Convert888to555(160,0,0),
+    ffr::Convert888to555(0,255,0), ffr::Convert888to555(0,160,0),
+    ffr::Convert888to555(0,0,255), ffr::Convert888to555(0,0,160),
+    ffr::Convert888to555(255,255,0), ffr::Convert888to555(160,160,0),
+    ffr::Convert888to555(0,255,255), ffr::Convert888to555(0,160,160),
+};
+
+// transforms with the current modelview, so the staged path is exercised
+class ModelViewProjection : public ffr::VertexFunction
+{
+public:
+    auto operator()(ffr::math::vec4 & in) -> void override
+    {
+        in = mvp_ * in;
+    }
+
+    auto setModelViewProjection(ffr::math::mat4 const & mvp) -> void override
+    {
+        mvp_ = mvp;
+    }
+
+private:
+    ffr::math::mat4 mvp_;
+};
+
+auto raw(int32_t const r) -> ffr::math::fixed32
+{
+    return ffr::math::fixed32::fromRaw(r);
+}
+
+auto setPerspective(GoldenContext & c) -> void
+{
+    c.setViewPort(WIDTH, HEIGHT);
+    c.setProjection(ffr::math::mat4::perspective(90.0_fx, 0.6666_fx, 1.0_fx, 1000.0_fx));
+}
+
+// identity projection, vertices are given in normalised device coordinates
+auto setOrtho(GoldenContext & c) -> void
+{
+    c.setViewPort(WIDTH, HEIGHT);
+    c.setProjection(ffr::math::mat4{});
+}
+
+// a 3 x 3 grid of cubes, each at its own rotation about all three axes
+auto drawCubeGrid(GoldenContext & c, int32_t const seed) -> void
+{
+    c.setVertexPointer(3, cube.data());
+    c.setColorPointer(cube_colors);
+    for (int32_t i = 0; i < 9; ++i)
+    {
+        ffr::math::fixed32 const x = raw(((i % 3) - 1) * (3 << 16));
+        ffr::math::fixed32 const y = raw(((i / 3) - 1) * (9 << 14));
+        ffr::math::fixed32 const a = raw((i + seed) * 47000);
+        c.loadMatrix(ffr::math::mat4::translation(ffr::math::vec3{x, y, -8.0_fx}));
+        c.multMatrix(ffr::math::mat4::rotationX(a));
+        c.multMatrix(ffr::math::mat4::rotationY(raw((i * 3 + seed) * 31000)));
+        c.multMatrix(ffr::math::mat4::rotationZ(raw(i * 23000)));
+        c.drawArray(ffr::DrawType::Triangles, 0, 36);
+    }
+}
+
+auto sceneCubes(GoldenContext & c) -> void
+{
+    setPerspective(c);
+    drawCubeGrid(c, 0);
+}
+
+auto sceneCubesVertexFunction(GoldenContext & c) -> void
+{
+    static ModelViewProjection vf;
+    setPerspective(c);
+    c.setVertexFunction(&vf);
+    drawCubeGrid(c, 5);
+    c.setVertexFunction(nullptr);
+}
+
+// one cube seen nearly edge on and one the camera is inside of
+auto sceneCubeClose(GoldenContext & c) -> void
+{
+    setPerspective(c);
+    c.setVertexPointer(3, cube.data());
+    c.setColorPointer(cube_colors);
+    c.loadMatrix(ffr::math::mat4::translation(ffr::math::vec3{0.0_fx, 0.0_fx, -2.2_fx}));
+    c.multMatrix(ffr::math::mat4::rotationY(0.78_fx));
+    c.multMatrix(ffr::math::mat4::rotationX(0.61_fx));
+    c.drawArray(ffr::DrawType::Triangles, 0, 36);
+}
+
+// fans of long thin triangles, down to zero area
+auto sceneSlivers(GoldenContext & c) -> void
+{
+    static ffr::math::fixed32 verts[16 * 9];
+    static uint16_t colors[16];
+    for (int32_t i = 0; i < 16; ++i)
+    {
+        ffr::math::fixed32 * const v = verts + (i * 9);
+        ffr::math::fixed32 const x = raw(-60000 + i * 8000);
+        ffr::math::fixed32 const spread = raw(i * i * 40);
+        v[0] = x;            v[1] = -0.95_fx;  v[2] = 0.0_fx;
+        v[3] = x + spread;   v[4] = 0.95_fx;   v[5] = 0.0_fx;
+        v[6] = x - spread;   v[7] = 0.9_fx;    v[8] = 0.0_fx;
+        colors[i] = uint16_t(0x7FFF - i * 0x0421);
+    }
+    setOrtho(c);
+    c.loadIdentity();
+    c.setVertexPointer(3, verts);
+    c.setColorPointer(colors);
+    c.drawArray(ffr::DrawType::Triangles, 0, 16 * 3);
+
+    // the same slivers mirrored, so both windings reach the rasterizer
+    c.loadMatrix(ffr::math::mat4::rotationY(3.14159_fx));
+    c.drawArray(ffr::DrawType::Triangles, 0, 16 * 3);
+}
+
+// a floor and a wall running through the near plane, and triangles much
+// larger than the frustum, in both windings
+auto sceneNearClip(GoldenContext & c) -> void
+{
+    static ffr::math::fixed32 const verts[] =
+    {
+        // floor from behind the camera to far ahead
+        -6.0_fx, -1.0_fx,  4.0_fx,   6.0_fx, -1.0_fx,  4.0_fx,   6.0_fx, -1.0_fx, -40.0_fx,
+        -6.0_fx, -1.0_fx,  4.0_fx,   6.0_fx, -1.0_fx, -40.0_fx, -6.0_fx, -1.0_fx, -40.0_fx,
+        -6.0_fx, -1.0_fx,  4.0_fx,   6.0_fx, -1.0_fx, -40.0_fx,  6.0_fx, -1.0_fx,  4.0_fx,
+        -6.0_fx, -1.0_fx,  4.0_fx,  -6.0_fx, -1.0_fx, -40.0_fx,  6.0_fx, -1.0_fx, -40.0_fx,
+        // wall on the right, crossing the near plane at an angle
+         1.5_fx, -1.0_fx,  3.0_fx,   1.5_fx,  2.0_fx,  3.0_fx,   3.0_fx,  0.5_fx, -9.0_fx,
+         1.5_fx, -1.0_fx,  3.0_fx,   3.0_fx,  0.5_fx, -9.0_fx,   1.5_fx,  2.0_fx,  3.0_fx,
+        // larger than the whole frustum
+        -90.0_fx, -60.0_fx, -20.0_fx,  90.0_fx, -60.0_fx, -20.0_fx,  0.0_fx,  90.0_fx, -30.0_fx,
+        -90.0_fx, -60.0_fx, -20.0_fx,  0.0_fx,  90.0_fx, -30.0_fx,   90.0_fx, -60.0_fx, -20.0_fx,
+    };
+    static uint16_t const colors[] =
+    {
+        ffr::Convert888to555(90,90,90), ffr::Convert888to555(140,140,140),
+        ffr::Convert888to555(90,90,90), ffr::Convert888to555(140,140,140),
+        ffr::Convert888to555(200,80,40), ffr::Convert888to555(200,80,40),
+        ffr::Convert888to555(20,30,70), ffr::Convert888to555(20,30,70),
+    };
+    setPerspective(c);
+    c.loadMatrix(ffr::math::mat4::rotationY(0.2_fx));
+
+    // the sky triangle first, everything else draws over it
+    c.setVertexPointer(3, verts);
+    c.setColorPointer(colors);
+    c.drawArray(ffr::DrawType::Triangles, 18, 6);
+    c.drawArray(ffr::DrawType::Triangles, 0, 18);
+}
+
+// overlapping triangles in each packed 555 blend mode
+auto sceneBlend(GoldenContext & c) -> void
+{
+    static ffr::math::fixed32 const verts[] =
+    {
+        -0.9_fx, -0.8_fx, 0.0_fx,   0.3_fx, -0.8_fx, 0.0_fx,  -0.3_fx,  0.8_fx, 0.0_fx,
+        -0.3_fx, -0.8_fx, 0.0_fx,   0.9_fx, -0.8_fx, 0.0_fx,   0.3_fx,  0.8_fx, 0.0_fx,
+        -0.6_fx,  0.9_fx, 0.0_fx,   0.6_fx,  0.9_fx, 0.0_fx,   0.0_fx, -0.9_fx, 0.0_fx,
+    };
+    static uint16_t const colors[] =
+    {
+        ffr::Convert888to555(200,40,40),
+        ffr::Convert888to555(40,200,120),
+        ffr::Convert888to555(120,120,230),
+    };
+    c.setClearColor(ffr::Convert888to555(60,60,60));
+    c.clear();
+    setOrtho(c);
+    c.loadIdentity();
+    c.setVertexPointer(3, verts);
+    c.setColorPointer(colors);
+
+    // both windings of every triangle, so one of them is front facing
+    static ffr::math::fixed32 mirrored[27];
+    for (int i = 0; i < 9; ++i)
+    {
+        int const src = (i / 3) * 3 + (2 - (i % 3));
+        mirrored[i * 3 + 0] = verts[src * 3 + 0];
+        mirrored[i * 3 + 1] = verts[src * 3 + 1];
+        mirrored[i * 3 + 2] = verts[src * 3 + 2];
+    }
+
+    ffr::BlendMode const modes[3] = {ffr::BlendMode::Add, ffr::BlendMode::Average, ffr::BlendMode::Subtract};
+    for (uint16_t t = 0; t < 3; ++t)
+    {
+        c.setBlendMode(modes[t]);
+        c.setVertexPointer(3, verts);
+        c.drawArray(ffr::DrawType::Triangles, t * 3, 3);
+        c.setVertexPointer(3, mirrored);
+        c.drawArray(ffr::DrawType::Triangles, t * 3, 3);
+    }
+    c.setBlendMode(ffr::BlendMode::Opaque);
+    c.setClearColor(0);
+}
+
+auto sceneTerrain(GoldenContext & c) -> void
+{
+    static uint8_t heights[256 * 256];
+    static uint16_t colors[256 * 256];
+    c.terrain({0.0_fx, 0.0_fx}, 0.0_fx, 50, 120, 120, 300, WIDTH, HEIGHT, heights, colors);
+}
+
+// a wall in front of a field of cubes. cubes it hides are culled by the
+// occlusion buffer, the wall is drawn last so any wrongly culled cube shows
+auto sceneOccluded(GoldenContext & c) -> void
+{
+    static auto const wall = ffr::util::createCube(4.0_fx, 1.0_fx, 0.25_fx);
+    static auto const bounds = ffr::math::aabb::fromPoints(cube);
+    static ffr::CoarseDepthBuffer<60, 40> occlusion;
+
+    setPerspective(c);
+    occlusion.clear();
+    c.setOcclusionBuffer(&occlusion);
+
+    c.loadMatrix(ffr::math::mat4::translation(ffr::math::vec3{1.0_fx, -1.2_fx, -6.0_fx}));
+    c.multMatrix(ffr::math::mat4::rotationY(0.3_fx));
+    c.setVertexPointer(3, wall.data());
+    c.setColorPointer(cube_colors);
+    c.drawOccluder(0, 36);
+    ffr::math::mat4 const wall_matrix = c.modelView();
+
+    c.setVertexPointer(3, cube.data());
+    for (int32_t i = 0; i < 48; ++i)
+    {
+        ffr::math::fixed32 const x = raw(((i % 8) - 4) * (5 << 15));
+        ffr::math::fixed32 const z = raw(-(9 << 16) - (i / 8) * (3 << 16));
+        c.loadMatrix(ffr::math::mat4::translation(ffr::math::vec3{x, raw((i % 3) * (3 << 15) - (2 << 16)), z}));
+        c.multMatrix(ffr::math::mat4::rotationY(raw(i * 19000)));
+        c.drawArray(ffr::DrawType::Triangles, 0, 36, bounds);
+    }
+
+    c.loadMatrix(wall_matrix);
+    c.setVertexPointer(3, wall.data());
+    c.drawArray(ffr::DrawType::Triangles, 0, 36);
+    c.setOcclusionBuffer(nullptr);
+}
+
+// one colour per triangle, lit from the upper left through the baked normals
+template<uint16_t VERTICES, uint16_t INDICES>
+consteval auto shade(ffr::util::IndexedMesh<VERTICES, INDICES> const & mesh, int const r, int const g, int const b)
+    -> ffr::util::array<uint16_t, INDICES / 3>
+{
+    ffr::math::vec3 light{-0.48_fx, 0.64_fx, 0.6_fx};
+    ffr::util::array<uint16_t, INDICES / 3> colors;
+    for (uint16_t t = 0; t < INDICES / 3; ++t)
+    {
+        ffr::math::vec3 n{};
+        for (uint16_t k = 0; k < 3; ++k)
+        {
+            uint16_t const v = mesh.indices[(t * 3) + k] * 3;
+            n = n + ffr::math::vec3{mesh.normals[v], mesh.normals[v + 1], mesh.normals[v + 2]};
+        }
+        ffr::math::fixed32 const d = n * light;
+        int32_t const lit = 64 + ((d > 0.0_fx) ? int32_t((d.raw() * 64) >> 16) : 0);
+        colors[t] = ffr::Convert888to555(uint8_t((r * lit) >> 8), uint8_t((g * lit) >> 8), uint8_t((b * lit) >> 8));
+    }
+    return colors;
+}
+
+// one colour per element, each taking the shade of its triangle, for
+// drawing a mesh's indices as points
+template<uint16_t VERTICES, uint16_t INDICES>
+consteval auto dots(ffr::util::IndexedMesh<VERTICES, INDICES> const & mesh, int const r, int const g, int const b)
+    -> ffr::util::array<uint16_t, INDICES>
+{
+    ffr::util::array<uint16_t, INDICES / 3> const faces = shade(mesh, r, g, b);
+    ffr::util::array<uint16_t, INDICES> colors;
+    for (uint16_t i = 0; i < INDICES; ++i)
+    {
+        colors[i] = faces[i / 3];
+    }
+    return colors;
+}
+
+constexpr auto ball = ffr::util::createSphere<16, 8>(1.0_fx);
+constexpr auto big_ball = ffr::util::createSphere<24, 12>(1.2_fx);
+constexpr auto can = ffr::util::createCylinder<12>(0.7_fx, 1.0_fx);
+constexpr auto hills = ffr::util::createGrid<10, 8>(14.0_fx, 10.0_fx, [](uint16_t const column, uint16_t const row) {
+    return ffr::math::fixed32::fromRaw(int32_t(((column * 7) + (row * 13)) % 5) << 14);
+});
+constexpr auto box = ffr::util::weld<[] { return ffr::util::createCube(0.6_fx, 0.6_fx, 0.6_fx); }>();
+
+constexpr auto ball_colors = shade(ball, 255, 80, 60);
+constexpr auto big_ball_colors = shade(big_ball, 80, 140, 255);
+constexpr auto can_colors = shade(can, 240, 220, 90);
+constexpr auto hills_colors = shade(hills, 90, 200, 90);
+constexpr auto box_colors = shade(box, 250, 250, 250);
+
+constexpr auto ball_dots = dots(ball, 255, 80, 60);
+constexpr auto big_ball_dots = dots(big_ball, 80, 140, 255);
+constexpr auto hills_dots = dots(hills, 90, 200, 90);
+
+// compile-time indexed meshes. the large sphere spans more vertices than
+// the context's lanes, so it takes the unshared path
+auto sceneIndexed(GoldenContext & c) -> void
+{
+    setPerspective(c);
+
+    auto const draw = [&](auto const & mesh, uint16_t const * colors) {
+        c.setVertexPointer(3, mesh.positions.data());
+        c.setColorPointer(colors);
+        c.drawElements(ffr::DrawType::Triangles, 0, mesh.indexCount(), mesh.indices.data());
+    };
+
+    c.loadMatrix(ffr::math::mat4::translation(ffr::math::vec3{0.0_fx, -2.5_fx, -9.0_fx}));
+    c.multMatrix(ffr::math::mat4::rotationX(0.2_fx));
+    draw(hills, hills_colors.data());
+
+    c.loadMatrix(ffr::math::mat4::translation(ffr::math::vec3{-2.6_fx, 0.0_fx, -7.0_fx}));
+    c.multMatrix(ffr::math::mat4::rotationZ(0.4_fx));
+    draw(ball, ball_colors.data());
+
+    c.loadMatrix(ffr::math::mat4::translation(ffr::math::vec3{0.0_fx, -0.3_fx, -7.0_fx}));
+    c.multMatrix(ffr::math::mat4::rotationX(0.5_fx));
+    draw(can, can_colors.data());
+
+    c.loadMatrix(ffr::math::mat4::translation(ffr::math::vec3{2.7_fx, 0.2_fx, -7.0_fx}));
+    c.multMatrix(ffr::math::mat4::rotationY(0.7_fx));
+    draw(big_ball, big_ball_colors.data());
+
+    c.loadMatrix(ffr::math::mat4::translation(ffr::math::vec3{0.0_fx, 2.0_fx, -7.5_fx}));
+    c.multMatrix(ffr::math::mat4::rotationY(0.6_fx));
+    c.multMatrix(ffr::math::mat4::rotationX(0.5_fx));
+    draw(box, box_colors.data());
+}
+
+// indexed meshes drawn as points, on the shared and unshared paths. the
+// large sphere has more elements than the lanes hold, so its points are
+// flushed mid draw. the hills go through drawArray
+auto scenePoints(GoldenContext & c) -> void
+{
+    setPerspective(c);
+
+    auto const draw = [&](auto const & mesh, uint16_t const * colors) {
+        c.setVertexPointer(3, mesh.positions.data());
+        c.setColorPointer(colors);
+        c.drawElements(ffr::DrawType::Points, 0, mesh.indexCount(), mesh.indices.data());
+    };
+
+    c.loadMatrix(ffr::math::mat4::translation(ffr::math::vec3{0.0_fx, -2.5_fx, -9.0_fx}));
+    c.multMatrix(ffr::math::mat4::rotationX(0.2_fx));
+    c.setVertexPointer(3, hills.positions.data());
+    c.setColorPointer(hills_dots.data());
+    c.drawArray(ffr::DrawType::Points, 0, hills.vertexCount());
+
+    c.loadMatrix(ffr::math::mat4::translation(ffr::math::vec3{-1.8_fx, 0.3_fx, -5.0_fx}));
+    c.multMatrix(ffr::math::mat4::rotationZ(0.4_fx));
+    draw(ball, ball_dots.data());
+
+    c.loadMatrix(ffr::math::mat4::translation(ffr::math::vec3{1.8_fx, 0.3_fx, -5.0_fx}));
+    c.multMatrix(ffr::math::mat4::rotationY(0.7_fx));
+    draw(big_ball, big_ball_dots.data());
+}
+
+Scene const scenes[] =
+{
+    {"cubes", 0, sceneCubes},
+    {"cubes_vertex_function", 0, sceneCubesVertexFunction},
+    {"cube_close", 0, sceneCubeClose},
+    {"slivers", 0, sceneSlivers},
+    {"near_clip", 0, sceneNearClip},
+    {"blend", 0, sceneBlend},
+    {"terrain", 0, sceneTerrain},
+    {"occluded", 0, sceneOccluded},
+    {"indexed", 0, sceneIndexed},
+    {"points", 0, scenePoints},
+};
+
+auto channel(uint16_t const c, int const k) -> int
+{
+    return (c >> (5 * k)) & 31;
+}
+
+auto writeImage(std::string const & path, Image const & img) -> bool
+{
+    FILE * const f = std::fopen(path.c_str(), "wb");
+    if (!f) { return false; }
+
+    std::fprintf(f, "FFR555 %u %u\n", WIDTH, HEIGHT);
+    for (uint32_t i = 0; i < PIXELS;)
+    {
+        uint16_t run = 1;
+        while ((i + run < PIXELS) && (run < 0xFFFF) && (img[i + run] == img[i])) { ++run; }
+        uint8_t const rec[4] = {uint8_t(run), uint8_t(run >> 8), uint8_t(img[i]), uint8_t(img[i] >> 8)};
+        std::fwrite(rec, 1, 4, f);
+        i += run;
+    }
+    return std::fclose(f) == 0;
+}
+
+auto readImage(std::string const & path, Image & img) -> bool
+{
+    FILE * const f = std::fopen(path.c_str(), "rb");
+    if (!f) { return false; }
+
+    unsigned w = 0;
+    unsigned h = 0;
+    bool ok = (std::fscanf(f, "FFR555 %u %u", &w, &h) == 2) && (std::fgetc(f) == '\n') && (w == WIDTH) && (h == HEIGHT);
+
+    img.assign(PIXELS, 0);
+    uint32_t i = 0;
+    uint8_t rec[4];
+    while (ok && (i < PIXELS) && (std::fread(rec, 1, 4, f) == 4))
+    {
+        uint32_t const run = rec[0] | (uint32_t(rec[1]) << 8);
+        uint16_t const colour = uint16_t(rec[2] | (rec[3] << 8));
+        ok = (i + run <= PIXELS);
+        for (uint32_t r = 0; ok && (r < run); ++r) { img[i++] = colour; }
+    }
+    std::fclose(f);
+    return ok && (i == PIXELS);
+}
+
+// viewable copy of a 555 image
+auto writePpm(std::string const & path, Image const & img) -> void
+{
+    FILE * const f = std::fopen(path.c_str(), "wb");
+    if (!f) { return; }
+
+    std::fprintf(f, "P6\n%u %u\n255\n", WIDTH, HEIGHT);
+    for (uint16_t const p : img)
+    {
+        ffr::util::array<uint8_t, 4> const rgb = ffr::Convert555to888(p);
+        std::fwrite(rgb.data(), 1, 3, f);
+    }
+    std::fclose(f);
+}
+
+// prints a per-pixel report and returns true when every pixel is within tolerance
+auto compare(Scene const & scene, Image const & expected, Image const & actual, int const tolerance) -> bool
+{
+    uint32_t differing = 0;
+    uint32_t failing = 0;
+    int worst = 0;
+    uint16_t x0 = WIDTH, y0 = HEIGHT, x1 = 0, y1 = 0;
+    Image diff(PIXELS, 0);
+
+    for (uint32_t i = 0; i < PIXELS; ++i)
+    {
+        if (expected[i] == actual[i]) { continue; }
+
+        int delta = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            int const d = channel(expected[i], k) - channel(actual[i], k);
+            delta = (d < 0 ? -d : d) > delta ? (d < 0 ? -d : d) : delta;
+        }
+        worst = (delta > worst) ? delta : worst;
+        differing++;
+
+        uint16_t const x = uint16_t(i % WIDTH);
+        uint16_t const y = uint16_t(i / WIDTH);
+        x0 = (x < x0) ? x : x0;
+        y0 = (y < y0) ? y : y0;
+        x1 = (x > x1) ? x : x1;
+        y1 = (y > y1) ? y : y1;
+
+        if (delta <= tolerance)
+        {
+            diff[i] = ffr::Convert888to555(255, 255, 0);
+            continue;
+        }
+
+        diff[i] = ffr::Convert888to555(255, 0, 0);
+        if (failing < MAX_REPORTED)
+        {
+            std::printf("    (%3u, %3u) expected %04x actual %04x, channel delta %d\n", x, y, expected[i], actual[i], delta);
+        }
+        failing++;
+    }
+
+    bool const pass = (failing == 0);
+    if (differing == 0)
+    {
+        std::printf("PASS %-24s exact\n", scene.name);
+    }
+    else
+    {
+        std::printf("%s %-24s %u pixels differ (%u beyond tolerance %d), max channel delta %d, within (%u, %u)-(%u, %u)\n",
+                    pass ? "PASS" : "FAIL", scene.name, differing, failing, tolerance, worst, x0, y0, x1, y1);
+    }
+
+    if (!pass)
+    {
+        std::string const base = options.out + "/" + scene.name;
+        writePpm(base + ".expected.ppm", expected);
+        writePpm(base + ".actual.ppm", actual);
+        writePpm(base + ".diff.ppm", diff);
+    }
+    return pass;
+}
+
+auto parseOptions(int argc, char *argv[]) -> bool
+{
+    for (int a = 1; a < argc; ++a)
+    {
+        if (std::strcmp(argv[a], "--update") == 0)
+        {
+            options.update = true;
+        }
+        else if ((std::strcmp(argv[a], "--tolerance") == 0) && (a + 1 < argc))
+        {
+            options.tolerance = std::atoi(argv[++a]);
+        }
+        else if ((std::strcmp(argv[a], "--filter") == 0) && (a + 1 < argc))
+        {
+            options.filter = argv[++a];
+        }
+        else if ((std::strcmp(argv[a], "--golden") == 0) && (a + 1 < argc))
+        {
+            options.golden = argv[++a];
+        }
+        else if ((std::strcmp(argv[a], "--out") == 0) && (a + 1 < argc))
+        {
+            options.out = argv[++a];
+        }
+        else if ((std::strcmp(argv[a], "--trace") == 0) && (a + 1 < argc))
+        {
+            options.trace = argv[++a];
+        }
+        else
+        {
+            std::fprintf(stderr, "usage: %s [--update] [--tolerance N] [--filter TEXT] [--golden DIR] [--out DIR] [--trace DIR]\n", argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+auto main(int argc, char *argv[]) -> int
+{
+    if (!parseOptions(argc, argv)) { return 2; }
+
+    GoldenContext * const c = new GoldenContext();
+    uint32_t failures = 0;
+
+    for (Scene const & scene : scenes)
+    {
+        if (options.filter && !std::strstr(scene.name, options.filter)) { continue; }
+
+        ffr::TraceWriter trace;
+        c->setTraceSink(options.trace ? &trace : nullptr);
+        c->invalidate();
+        c->clear();
+        scene.render(*c);
+        Image const actual(c->pixels(), c->pixels() + PIXELS);
+
+        if (options.trace)
+        {
+            trace.endFrame();
+            std::string const trace_path = std::string(options.trace) + "/" + scene.name + ".ffrtrace";
+            FILE * const f = std::fopen(trace_path.c_str(), "wb");
+            if (!f || (std::fwrite(trace.bytes(), 1, trace.size(), f) != trace.size()))
+            {
+                std::printf("could not write %s\n", trace_path.c_str());
+                failures++;
+            }
+            if (f) { std::fclose(f); }
+        }
+
+        std::string const path = options.golden + "/" + scene.name + ".ffr555";
+        if (options.update)
+        {
+            bool const ok = writeImage(path, actual);
+            std::printf("%s %s\n", ok ? "wrote" : "could not write", path.c_str());
+            failures += ok ? 0 : 1;
+            continue;
+        }
+
+        Image expected;
+        if (!readImage(path, expected))
+        {
+            std::printf("FAIL %-24s no readable reference at %s\n", scene.name, path.c_str());
+            failures++;
+            continue;
+        }
+
+        int const tolerance = (options.tolerance >= 0) ? options.tolerance : scene.tolerance;
+        failures += compare(scene, expected, actual, tolerance) ? 0 : 1;
+    }
+
+    delete c;
+    return (failures == 0) ? 0 : 1;
+}
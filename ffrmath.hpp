@@ -1,5 +1,6 @@
 #pragma once
 
+#include <bit>
 #include <cstdint>
 #include <compare>
 
@@ -13,6 +14,8 @@ class fixed32 //16.16
     static constexpr int32_t const FIX_SHIFT = 16;
     static constexpr int32_t const FIX_SCALE = 65536;
     static constexpr float const FIX_SCALEF = 65536.0f;
+    static constexpr int32_t const FIX_MAX = INT32_MAX;
+    static constexpr int32_t const FIX_MIN = -INT32_MAX; // symmetric, so negation cannot wrap
 
     int32_t data = 0;
 
@@ -20,7 +23,7 @@ public:
     constexpr fixed32() = default;
 
     constexpr explicit fixed32(int16_t const &that)
-        : data(that << FIX_SHIFT)
+        : data(int32_t(that) * FIX_SCALE)
     {}
 
     consteval explicit fixed32(float const &that)
@@ -34,7 +37,7 @@ public:
 
     constexpr auto operator=(int16_t const that) -> fixed32 &
     {
-        data = that << FIX_SHIFT;
+        data = int32_t(that) * FIX_SCALE;
         return (*this);
     }
 
@@ -51,6 +54,24 @@ public:
 
     constexpr explicit operator int16_t() const { return data >> FIX_SHIFT; }
 
+    // raw 16.16 access for kernels that work on the bit pattern directly
+    static constexpr auto fromRaw(int32_t const raw) -> fixed32
+    {
+        fixed32 r;
+        r.data = raw;
+        return r;
+    }
+
+    [[nodiscard]] constexpr auto raw() const -> int32_t { return data; }
+
+    // clamp a wide raw 16.16 value into range
+    static constexpr auto saturate(int64_t const raw) -> fixed32
+    {
+        fixed32 r;
+        r.data = (raw > FIX_MAX) ? FIX_MAX : ((raw < FIX_MIN) ? FIX_MIN : static_cast<int32_t>(raw));
+        return r;
+    }
+
     //consteval explicit operator float() const { return data / FIX_SCALEF; }
 
     constexpr auto operator+(fixed32 const that) const -> fixed32
@@ -74,11 +95,12 @@ public:
         return r;
     }
 
+    // division always saturates: a zero divisor yields the largest value
+    // with the sign of the dividend, as does a quotient out of range
     constexpr auto operator/(fixed32 const that) const -> fixed32
     {
-        fixed32 r;
-        r.data = (int64_t(data) * FIX_SCALE) / (that.data);
-        return r;
+        if (that.data == 0) { return saturate((data < 0) ? FIX_MIN : FIX_MAX); }
+        return saturate((int64_t(data) * FIX_SCALE) / (that.data));
     }
 
     constexpr auto operator-() const -> fixed32
@@ -92,6 +114,95 @@ public:
     {
         return this->data <=> that.data;
     }
+
+    constexpr auto operator==(fixed32 const &that) const -> bool
+    {
+        return this->data == that.data;
+    }
+
+    // saturating variants of the wrapping operators above
+    [[nodiscard]] constexpr auto addSat(fixed32 const that) const -> fixed32
+    {
+        return saturate(int64_t(data) + that.data);
+    }
+
+    [[nodiscard]] constexpr auto subSat(fixed32 const that) const -> fixed32
+    {
+        return saturate(int64_t(data) - that.data);
+    }
+
+    [[nodiscard]] constexpr auto mulSat(fixed32 const that) const -> fixed32
+    {
+        return saturate((int64_t(data) * that.data) >> FIX_SHIFT);
+    }
+};
+
+class fixed64 //32.32, wide accumulator for sums of fixed32 products
+{
+    static constexpr int32_t const FIX_SHIFT = 32;
+
+    int64_t data = 0;
+
+public:
+    constexpr fixed64() = default;
+
+    constexpr explicit fixed64(fixed32 const that)
+        : data(int64_t(that.raw()) * 65536)
+    {}
+
+    static constexpr auto fromRaw(int64_t const raw) -> fixed64
+    {
+        fixed64 r;
+        r.data = raw;
+        return r;
+    }
+
+    [[nodiscard]] constexpr auto raw() const -> int64_t { return data; }
+
+    // exact product of two 16.16 values
+    static constexpr auto product(fixed32 const a, fixed32 const b) -> fixed64
+    {
+        fixed64 r;
+        r.data = int64_t(a.raw()) * b.raw();
+        return r;
+    }
+
+    constexpr auto operator+(fixed64 const that) const -> fixed64
+    {
+        fixed64 r;
+        r.data = data + that.data;
+        return r;
+    }
+
+    constexpr auto operator-(fixed64 const that) const -> fixed64
+    {
+        fixed64 r;
+        r.data = data - that.data;
+        return r;
+    }
+
+    // 32.32 / 16.16 lands directly on 16.16; saturates like fixed32::operator/
+    constexpr auto operator/(fixed32 const that) const -> fixed32
+    {
+        if (that.raw() == 0) { return fixed32::saturate((data < 0) ? INT64_MIN : INT64_MAX); }
+        return fixed32::saturate(data / that.raw());
+    }
+
+    // round to nearest and saturate, once, at the end of an accumulation
+    constexpr explicit operator fixed32() const
+    {
+        return fixed32::saturate((data + (int64_t(1) << (FIX_SHIFT - 17))) >> (FIX_SHIFT - 16));
+    }
+
+    constexpr auto operator<=>(fixed64 const &that) const -> std::strong_ordering
+    {
+        return this->data <=> that.data;
+    }
+
+    constexpr auto operator==(fixed64 const &that) const -> bool
+    {
+        return this->data == that.data;
+    }
 };
 
 consteval auto operator""_fx(long double f) -> math::fixed32
@@ -128,124 +239,297 @@ constexpr auto pow(auto const b, auto const e) -> decltype(b)
     return r;
 }
 
+// Entries in one turn of the sine table used by sin/cos/sincos. Must be a
+// power of two. Interpolated error is 1.25 ulp at 1024 entries, 2 at 512.
+static constexpr uint16_t SINTABLE_SIZE = 1024;
+
+class SinCos
+{
+public:
+    fixed32 sin, cos;
+};
+
 namespace
 {
-using LUT = util::array<fixed32, GAMDEG_IN_CIRCLE>;
+// A turn and a quarter plus one entry, so cos is sin a quarter turn on and
+// interpolation can always read the next entry without wrapping.
+template<uint16_t SIZE>
+using SinLUT = util::array<fixed32, SIZE + (SIZE / 4) + 1>;
 
 consteval auto taylorSin(float const x) -> float
 {
     float const ts = x - ((x * x * x) / 6.0f) + ((x * x * x * x * x) / 120.0f)
                      - ((x * x * x * x * x * x * x) / 5040.0f)
-                     + ((x * x * x * x * x * x * x * x * x) / 32880.0f);
+                     + ((x * x * x * x * x * x * x * x * x) / 362880.0f);
     return ts;
 }
 
-consteval auto makeSinTable() -> LUT
+template<uint16_t SIZE>
+consteval auto makeSinTable() -> SinLUT<SIZE>
 {
-    uint16_t const quadrantSize = GAMDEG_IN_CIRCLE/4;
-    LUT r{};
+    uint16_t const quadrantSize = SIZE / 4;
 
-    uint16_t k = (quadrantSize*2);
-    for (uint16_t i = 0; i <= quadrantSize; ++i)
+    // first quadrant, rounded to nearest
+    util::array<fixed32, (SIZE / 4) + 1> q{};
+    for (uint16_t i = 0; i < quadrantSize; ++i)
     {
-        float x = (TAUF / GAMDEG_IN_CIRCLE) * i;
-        r[i] = taylorSin(x);
-        r[k] = r[i];
-        --k;
+        float const x = (TAUF / SIZE) * i;
+        q[i] = fixed32::fromRaw(static_cast<int32_t>(taylorSin(x) * 65536.0f + 0.5f));
     }
+    q[quadrantSize] = 1.0_fx;
 
-    k = quadrantSize*2;
-    for(uint16_t  i = 0; i < quadrantSize*2; ++i)
+    SinLUT<SIZE> r{};
+    for (uint16_t i = 0; i < r.size(); ++i)
     {
-        r[k] = -r[i];
-        ++k;
+        uint16_t const k = i % quadrantSize;
+        switch ((i / quadrantSize) % 4)
+        {
+        case 0: r[i] = q[k]; break;
+        case 1: r[i] = q[quadrantSize - k]; break;
+        case 2: r[i] = -q[k]; break;
+        default: r[i] = -q[quadrantSize - k]; break;
+        }
     }
 
-    r[quadrantSize * 0] = 0.0_fx;
-    r[quadrantSize * 1] = 1.0_fx;
-    r[quadrantSize * 2] = 0.0_fx;
-    r[quadrantSize * 3] = -1.0_fx;
-
     return r;
 }
 
-consteval auto taylorCos(float const x) -> float
+template<uint16_t SIZE>
+constexpr SinLUT<SIZE> SINTABLE = makeSinTable<SIZE>();
+} // namespace
+
+constexpr auto clampGamdeg(int16_t gamdeg) -> int16_t
 {
-    float const tc = 1.0f - ((x * x) / 2.0f) + ((x * x * x * x) / 24.0f)
-                     - ((x * x * x * x * x * x) / 720.0f)
-                     + ((x * x * x * x * x * x * x * x) / 40320);
-    return tc;
+    return (gamdeg % GAMDEG_IN_CIRCLE + GAMDEG_IN_CIRCLE) % GAMDEG_IN_CIRCLE;
 }
 
-consteval auto makeCosTable() -> LUT
+// Newton-Raphson seed tables. Both operate on a mantissa m normalised into the
+// top of a uint32_t (0.32 format) and return seeds in 2.30 format.
+namespace
 {
-    const uint16_t quadrantSize = GAMDEG_IN_CIRCLE/4;
-    LUT r{};
+static constexpr uint8_t const RECIP_SEED_BITS = 6;
+static constexpr uint8_t const RSQRT_SEED_BITS = 7;
+
+using RecipLUT = util::array<uint32_t, (1 << RECIP_SEED_BITS)>;
+using RsqrtLUT = util::array<uint32_t, (1 << RSQRT_SEED_BITS) - (1 << (RSQRT_SEED_BITS - 2))>;
 
-    uint16_t k = (quadrantSize*2);
-    for (uint16_t i = 0; i <= quadrantSize; ++i)
+// 1/v for v in [0.5, 1), sampled at the midpoint of each interval
+consteval auto makeRecipTable() -> RecipLUT
+{
+    RecipLUT r{};
+    for (uint32_t i = 0; i < (1 << RECIP_SEED_BITS); ++i)
     {
-        float x = (TAUF / GAMDEG_IN_CIRCLE) * i;
-        r[i] = taylorCos(x);
-        r[k] = -r[i];
-        --k;
+        uint64_t const mid = (uint64_t(1) << 31) + (uint64_t(i) << (31 - RECIP_SEED_BITS))
+                             + (uint64_t(1) << (30 - RECIP_SEED_BITS));
+        r[i] = static_cast<uint32_t>((uint64_t(1) << 62) / mid);
     }
+    return r;
+}
 
-    k = quadrantSize*2;
-    for(uint16_t  i = 0; i < quadrantSize*2; ++i)
+// 1/sqrt(v) for v in [0.25, 1), sampled at the midpoint of each interval
+consteval auto makeRsqrtTable() -> RsqrtLUT
+{
+    RsqrtLUT r{};
+    for (int32_t i = 0; i < r.size(); ++i)
     {
-        r[k] = -r[i];
-        ++k;
+        uint64_t const mid = (uint64_t(i + (1 << (RSQRT_SEED_BITS - 2))) << (32 - RSQRT_SEED_BITS))
+                             + (uint64_t(1) << (31 - RSQRT_SEED_BITS));
+
+        // integer sqrt of mid * 2^32, i.e. sqrt(v) in 0.32
+        uint64_t lo = 0;
+        uint64_t hi = uint64_t(1) << 32;
+        while (lo + 1 < hi)
+        {
+            uint64_t const m = (lo + hi) / 2;
+            if (m * m <= (mid << 32)) { lo = m; } else { hi = m; }
+        }
+        r[i] = static_cast<uint32_t>((uint64_t(1) << 62) / lo);
     }
-
-    r[quadrantSize * 0] = 1.0_fx;
-    r[quadrantSize * 1] = 0.0_fx;
-    r[quadrantSize * 2] = -1.0_fx;
-    r[quadrantSize * 3] = 0.0_fx;
-
     return r;
 }
+
+// namespace scope so the tables are emitted once rather than rebuilt per call
+constexpr RecipLUT RECIPTABLE = makeRecipTable();
+constexpr RsqrtLUT RSQRTTABLE = makeRsqrtTable();
 } // namespace
 
-constexpr auto clampGamdeg(int16_t gamdeg) -> int16_t
+// 1/sqrt(v) in 2.30 for m = v * 2^32, v in [0.25, 1): table seed plus two
+// Newton-Raphson steps. Shared by sqrt and rsqrt.
+namespace
 {
-    return (gamdeg % GAMDEG_IN_CIRCLE + GAMDEG_IN_CIRCLE) % GAMDEG_IN_CIRCLE;
+constexpr auto rsqrtNormalised(uint64_t const m) -> uint64_t
+{
+    uint64_t y = RSQRTTABLE[(m >> (32 - RSQRT_SEED_BITS)) - (1 << (RSQRT_SEED_BITS - 2))];
+    for (uint8_t i = 0; i < 2; ++i)
+    {
+        uint64_t const y2 = (y * y) >> 30;
+        uint64_t const my2 = (m * y2) >> 32;
+        y = (y * ((uint64_t(3) << 30) - my2)) >> 31;
+    }
+    return y;
 }
+} // namespace
 
+// Square root as n * rsqrt(n) at 0.32 precision, then nudged to the correctly
+// rounded result. Max error 0.5 ulp (2^-17). Non-positive input returns 0.
 constexpr auto sqrt(fixed32 const n) -> fixed32
 {
-    return 1.0_fx;
-    //return static_cast<fixed32>(std::sqrtf(static_cast<float>(n)));
+    int32_t const d = n.raw();
+    if (d <= 0) { return fixed32{}; }
+
+    uint32_t const u = uint32_t(d);
+    int const s = std::countl_zero(u) & ~1; // even shift keeps the exponent halvable
+    uint64_t const m = uint64_t(u) << s;    // v = m / 2^32 in [0.25, 1)
+
+    // sqrt(v) = v / sqrt(v) in 0.32, then sqrt(n) = sqrt(v) * 2^(8 - s/2)
+    uint64_t const sv = (m * rsqrtNormalised(m)) >> 30;
+    uint64_t res = sv >> (8 + (s >> 1));
+
+    uint64_t const target = uint64_t(u) << 16;
+    while (res * res + res < target) { ++res; }
+    while (res != 0 && res * res - res >= target) { --res; }
+
+    return fixed32::fromRaw(static_cast<int32_t>(res));
 }
 
-constexpr auto sin(fixed32 const a) -> fixed32
+// 1/v in 2.30 for m = v * 2^32, v in [0.5, 1): table seed plus two
+// Newton-Raphson steps. Shared by reciprocal and recip32.
+namespace
 {
-    constexpr auto SINTABLE = makeSinTable();
+constexpr auto recipNormalised(uint64_t const m) -> uint64_t
+{
+    uint64_t r = RECIPTABLE[(m >> (31 - RECIP_SEED_BITS)) & ((1 << RECIP_SEED_BITS) - 1)];
+    r = (r * ((uint64_t(2) << 30) - ((m * r) >> 32))) >> 30;
+    r = (r * ((uint64_t(2) << 30) - ((m * r) >> 32))) >> 30;
+    return r;
+}
+} // namespace
+
+// 1/n via a 64-entry seed table and two Newton-Raphson steps, no divide.
+// Correctly rounded: max error 0.5 ulp (2^-17). Results that do not fit
+// 16.16 (|n| < 2^-15, including 0) saturate to the largest magnitude.
+constexpr auto reciprocal(fixed32 const n) -> fixed32
+{
+    int32_t const d = n.raw();
+    bool const neg = d < 0;
+    uint32_t const u = neg ? uint32_t(0) - uint32_t(d) : uint32_t(d);
+
+    if (u <= 2) { return fixed32::fromRaw(neg ? -INT32_MAX : INT32_MAX); }
+
+    int const s = std::countl_zero(u);
+    uint64_t const r = recipNormalised(uint64_t(u) << s);
+
+    // 1/n = r * 2^(s - 30) in raw units, then nudge to the correctly rounded
+    // quotient; the estimate is within a few ulp so this settles in 1-3 steps
+    uint64_t q = (s >= 30) ? (r << (s - 30)) : ((r + (uint64_t(1) << (29 - s))) >> (30 - s));
+    while (2 * q * u + u < (uint64_t(1) << 33)) { ++q; }
+    while (2 * q * u > (uint64_t(1) << 33) + u) { --q; }
 
-    fixed32 const gd = a * RAD_TO_GAMDEG;
-    int16_t const gdi = clampGamdeg(static_cast<int16_t>(gd));
+    int32_t const q32 = (q > uint64_t(INT32_MAX)) ? INT32_MAX : static_cast<int32_t>(q);
 
-    return fixed32{SINTABLE[gdi]};
+    return fixed32::fromRaw(neg ? -q32 : q32);
 }
 
-constexpr auto cos(fixed32 const a) -> fixed32
+// A reciprocal kept at full Newton-Raphson precision (about 2^-30 relative)
+// so one divisor can be applied to several numerators with a multiply each,
+// e.g. the x, y and z of a perspective divide. n * recip32(d) matches n / d
+// to within 1 ulp while |n / d| < 2^11; past that the relative error of the
+// mantissa shows and the result drifts by about |n / d| * 2^-12 ulp (7 ulp
+// near 2^15). The w-divide and clip uses keep |n| <= |d| and stay within
+// 0.5 ulp. A zero divisor behaves like the smallest positive value.
+class recip32
+{
+    int64_t mant = 0; // signed 2.30 mantissa
+    uint8_t shift = 0;
+
+public:
+    constexpr explicit recip32(fixed32 const d)
+    {
+        int32_t const raw = d.raw();
+        uint32_t u = (raw < 0) ? uint32_t(0) - uint32_t(raw) : uint32_t(raw);
+        if (u == 0) { u = 1; }
+
+        int const s = std::countl_zero(u);
+        int64_t const r = static_cast<int64_t>(recipNormalised(uint64_t(u) << s));
+
+        mant = (raw < 0) ? -r : r;
+        shift = static_cast<uint8_t>(46 - s);
+    }
+
+    friend constexpr auto operator*(fixed32 const n, recip32 const &r) -> fixed32
+    {
+        int64_t const q = ((int64_t(n.raw()) * r.mant) + (int64_t(1) << (r.shift - 1))) >> r.shift;
+        if (q > INT32_MAX) { return fixed32::fromRaw(INT32_MAX); }
+        if (q < -INT32_MAX) { return fixed32::fromRaw(-INT32_MAX); }
+        return fixed32::fromRaw(static_cast<int32_t>(q));
+    }
+};
+
+// 1/sqrt(n) via a 96-entry seed table and two Newton-Raphson steps, no divide.
+// Max error 1 ulp (2^-16). Non-positive input saturates.
+constexpr auto rsqrt(fixed32 const n) -> fixed32
 {
-    constexpr LUT COSTABLE = makeCosTable();
+    int32_t const d = n.raw();
+    if (d <= 0) { return fixed32::fromRaw(INT32_MAX); }
+
+    uint32_t const u = uint32_t(d);
+    int const s = std::countl_zero(u) & ~1; // even shift keeps the exponent halvable
+    uint64_t const m = uint64_t(u) << s;    // v = m / 2^32 in [0.25, 1)
 
-    fixed32 const gd = a * RAD_TO_GAMDEG;
-    int16_t const gdi = clampGamdeg(static_cast<int16_t>(gd));
+    uint64_t const y = rsqrtNormalised(m);
+
+    // 1/sqrt(n) = y * 2^(s/2 - 22) in raw units
+    int const sh = 22 - (s >> 1);
+    return fixed32::fromRaw(static_cast<int32_t>((y + (uint64_t(1) << (sh - 1))) >> sh));
+}
+
+// sin and cos from one table position, linearly interpolated between
+// entries. The position is formed in 64 bits, so any angle wraps correctly.
+template<uint16_t SIZE = SINTABLE_SIZE>
+constexpr auto sincos(fixed32 const a) -> SinCos
+{
+    static_assert(SIZE >= 16 && (SIZE & (SIZE - 1)) == 0, "sine table size must be a power of two");
+
+    // radians to table index with 20 fractional bits; a 16.16 constant would
+    // lose about an ulp of angle per turn
+    constexpr int64_t RAD_TO_INDEX = static_cast<int64_t>((SIZE / 6.283185307179586) * (1 << 20) + 0.5);
+    SinLUT<SIZE> const &table = SINTABLE<SIZE>;
+
+    int64_t const pos = (int64_t(a.raw()) * RAD_TO_INDEX) >> 20; // 16 fractional bits
+    uint16_t const i = static_cast<uint16_t>((pos >> 16) & (SIZE - 1));
+    int64_t const frac = pos & 0xFFFF;
+
+    auto const lerp = [&](uint16_t const k) -> fixed32 {
+        int32_t const s0 = table[k].raw();
+        int32_t const s1 = table[k + 1].raw();
+        return fixed32::fromRaw(s0 + static_cast<int32_t>((int64_t(s1 - s0) * frac + 0x8000) >> 16));
+    };
+
+    return {lerp(i), lerp(i + (SIZE / 4))};
+}
+
+template<uint16_t SIZE = SINTABLE_SIZE>
+constexpr auto sin(fixed32 const a) -> fixed32
+{
+    return sincos<SIZE>(a).sin;
+}
 
-    return fixed32{COSTABLE[gdi]};
+template<uint16_t SIZE = SINTABLE_SIZE>
+constexpr auto cos(fixed32 const a) -> fixed32
+{
+    return sincos<SIZE>(a).cos;
 }
 
 constexpr auto tan(fixed32 const n) -> fixed32
 {
-    return sin(n) / cos(n);
+    SinCos const sc = sincos(n);
+    return sc.sin / sc.cos;
 }
 
 constexpr auto cot(fixed32 const n) -> fixed32
 {
-    return cos(n) / sin(n);
+    SinCos const sc = sincos(n);
+    return sc.cos / sc.sin;
 }
 
 constexpr auto abs(auto n) -> decltype(n)
@@ -289,12 +573,12 @@ public:
 
     constexpr auto operator+(vec3 const &that) -> vec3
     {
-        return {this->x + that.x, this->y + that.y, z + that.x};
+        return {this->x + that.x, this->y + that.y, z + that.z};
     }
 
     constexpr auto operator-(vec3 const &that) -> vec3
     {
-        return {this->x - that.x, this->y - that.y, z - that.x};
+        return {this->x - that.x, this->y - that.y, z - that.z};
     }
 
     constexpr auto operator*(fixed32 const &that) -> vec3
@@ -309,7 +593,8 @@ public:
 
     constexpr auto operator*(vec3 const &that) -> fixed32
     {
-        return {(this->x * that.x) + (this->y * that.y) + (this->z * that.z)};
+        return fixed32(fixed64::product(this->x, that.x) + fixed64::product(this->y, that.y)
+                       + fixed64::product(this->z, that.z));
     }
 
     [[nodiscard]] constexpr auto length() const -> fixed32
@@ -329,12 +614,12 @@ public:
 
     constexpr auto operator+(vec4 const &that) const -> vec4
     {
-        return {this->x + that.x, this->y + that.y, z + that.x, w + that.w};
+        return {this->x + that.x, this->y + that.y, z + that.z, w + that.w};
     }
 
     constexpr auto operator-(vec4 const &that) const -> vec4
     {
-        return {this->x - that.x, this->y - that.y, z - that.x, w - that.w};
+        return {this->x - that.x, this->y - that.y, z - that.z, w - that.w};
     }
 
     constexpr auto operator*(fixed32 const &that) const -> vec4
@@ -349,7 +634,8 @@ public:
 
     constexpr auto operator*(vec4 const &that) const -> fixed32
     {
-        return {(this->x * that.x) + (this->y * that.y) + (this->z * that.z) + (this->w * that.w)};
+        return fixed32(fixed64::product(this->x, that.x) + fixed64::product(this->y, that.y)
+                       + fixed64::product(this->z, that.z) + fixed64::product(this->w, that.w));
     }
 
     [[nodiscard]] constexpr auto length() const -> fixed32
@@ -443,35 +729,106 @@ public:
         return n;
     }
 
-    constexpr auto operator*(mat4 const &that) -> mat4
+    // A column at a time against four independent 64-bit lanes: the inner
+    // loop has no cross-lane dependency, so it maps onto SIMD multiplies
+    // where the target has them and stays a plain loop where it does not.
+    constexpr auto operator*(mat4 const &that) const -> mat4
     {
         mat4 n;
 
+        for (uint8_t c = 0; c < 4; ++c) {
+            int64_t acc[4] = {0, 0, 0, 0};
+            for (uint8_t k = 0; k < 4; ++k) {
+                int64_t const b = that.m[c][k].raw();
+                for (uint8_t r = 0; r < 4; ++r) {
+                    acc[r] += int64_t(this->m[k][r].raw()) * b;
+                }
+            }
+            for (uint8_t r = 0; r < 4; ++r) {
+                n.m[c][r] = fixed32(fixed64::fromRaw(acc[r]));
+            }
+        }
+
+        return n;
+    }
+
+    constexpr auto operator==(mat4 const &that) const -> bool
+    {
         for (uint8_t c = 0; c < 4; ++c) {
             for (uint8_t r = 0; r < 4; ++r) {
-                n.m[c][r] = (this->m[0][r] * that.m[c][0]) + (this->m[1][r] * that.m[c][1])
-                            + (this->m[2][r] * that.m[c][2]) + (this->m[3][r] * that.m[c][3]);
+                if (!(m[c][r] == that.m[c][r])) { return false; }
             }
         }
+        return true;
+    }
+
+    // true if the bottom row is (0, 0, 0, 1), i.e. no projective part
+    [[nodiscard]] constexpr auto isAffine() const -> bool
+    {
+        return m[0][3] == 0.0_fx && m[1][3] == 0.0_fx && m[2][3] == 0.0_fx && m[3][3] == 1.0_fx;
+    }
+
+    // this * that for two affine matrices: 36 products instead of 64
+    [[nodiscard]] constexpr auto mulAffine(mat4 const &that) const -> mat4
+    {
+        mat4 n;
+
+        for (uint8_t c = 0; c < 4; ++c) {
+            int64_t acc[3] = {0, 0, 0};
+            for (uint8_t k = 0; k < 3; ++k) {
+                int64_t const b = that.m[c][k].raw();
+                for (uint8_t r = 0; r < 3; ++r) {
+                    acc[r] += int64_t(this->m[k][r].raw()) * b;
+                }
+            }
+            if (c == 3) {
+                for (uint8_t r = 0; r < 3; ++r) {
+                    acc[r] += int64_t(this->m[3][r].raw()) * 65536;
+                }
+            }
+            for (uint8_t r = 0; r < 3; ++r) {
+                n.m[c][r] = fixed32(fixed64::fromRaw(acc[r]));
+            }
+        }
+
+        return n;
+    }
+
+    // this * that for an affine matrix: w passes through, 12 products
+    [[nodiscard]] constexpr auto mulAffine(vec4 const &that) const -> vec4
+    {
+        vec4 n;
+
+        n.x = fixed32(fixed64::product(this->m[0][0], that.x) + fixed64::product(this->m[1][0], that.y)
+                      + fixed64::product(this->m[2][0], that.z) + fixed64::product(this->m[3][0], that.w));
+
+        n.y = fixed32(fixed64::product(this->m[0][1], that.x) + fixed64::product(this->m[1][1], that.y)
+                      + fixed64::product(this->m[2][1], that.z) + fixed64::product(this->m[3][1], that.w));
+
+        n.z = fixed32(fixed64::product(this->m[0][2], that.x) + fixed64::product(this->m[1][2], that.y)
+                      + fixed64::product(this->m[2][2], that.z) + fixed64::product(this->m[3][2], that.w));
+
+        n.w = that.w;
 
         return n;
     }
 
-    constexpr auto operator*(vec4 const &that) -> vec4
+    constexpr auto operator*(vec4 const &that) const -> vec4
     {
         vec4 n;
 
-        n.x = (this->m[0][0] * that.x) + (this->m[1][0] * that.y) + (this->m[2][0] * that.z)
-              + (this->m[3][0] * that.w);
+        // each row is summed at full precision and rounded once
+        n.x = fixed32(fixed64::product(this->m[0][0], that.x) + fixed64::product(this->m[1][0], that.y)
+                      + fixed64::product(this->m[2][0], that.z) + fixed64::product(this->m[3][0], that.w));
 
-        n.y = (this->m[0][1] * that.x) + (this->m[1][1] * that.y) + (this->m[2][1] * that.z)
-              + (this->m[3][1] * that.w);
+        n.y = fixed32(fixed64::product(this->m[0][1], that.x) + fixed64::product(this->m[1][1], that.y)
+                      + fixed64::product(this->m[2][1], that.z) + fixed64::product(this->m[3][1], that.w));
 
-        n.z = (this->m[0][2] * that.x) + (this->m[1][2] * that.y) + (this->m[2][2] * that.z)
-              + (this->m[3][2] * that.w);
+        n.z = fixed32(fixed64::product(this->m[0][2], that.x) + fixed64::product(this->m[1][2], that.y)
+                      + fixed64::product(this->m[2][2], that.z) + fixed64::product(this->m[3][2], that.w));
 
-        n.w = (this->m[0][3] * that.x) + (this->m[1][3] * that.y) + (this->m[2][3] * that.z)
-              + (this->m[3][3] * that.w);
+        n.w = fixed32(fixed64::product(this->m[0][3], that.x) + fixed64::product(this->m[1][3], that.y)
+                      + fixed64::product(this->m[2][3], that.z) + fixed64::product(this->m[3][3], that.w));
 
         return n;
     }
@@ -487,8 +844,9 @@ public:
 
         n.m[0][0] = f / aspect;
         n.m[1][1] = f;
-        n.m[2][2] = (zFar + zNear) / (zNear - zFar);
-        n.m[3][2] = (2.0_fx * zFar * zNear) / (zNear - zFar);
+        // numerators widened so large zFar cannot overflow before the divide
+        n.m[2][2] = (fixed64(zFar) + fixed64(zNear)) / (zNear - zFar);
+        n.m[3][2] = (fixed64::product(zFar, zNear) + fixed64::product(zFar, zNear)) / (zNear - zFar);
         n.m[2][3] = -1.0_fx;
         n.m[3][3] = 0.0_fx;
 
@@ -501,8 +859,8 @@ public:
 
         n.m[0][0] = 1.0_fx;
         n.m[1][1] = 1.0_fx;
-        n.m[2][2] = (zFar + zNear) / (zNear - zFar);
-        n.m[3][2] = (2.0_fx * zFar * zNear) / (zNear - zFar);
+        n.m[2][2] = (fixed64(zFar) + fixed64(zNear)) / (zNear - zFar);
+        n.m[3][2] = (fixed64::product(zFar, zNear) + fixed64::product(zFar, zNear)) / (zNear - zFar);
         n.m[2][3] = -1.0_fx;
         n.m[3][3] = 0.0_fx;
 
@@ -537,10 +895,12 @@ public:
     {
         mat4 r;
 
-        r.m[1][1] = cos(radians);
-        r.m[1][2] = sin(radians);
-        r.m[2][1] = -sin(radians);
-        r.m[2][2] = cos(radians);
+        SinCos const sc = sincos(radians);
+
+        r.m[1][1] = sc.cos;
+        r.m[1][2] = sc.sin;
+        r.m[2][1] = -sc.sin;
+        r.m[2][2] = sc.cos;
 
         return r;
     }
@@ -549,10 +909,12 @@ public:
     {
         mat4 r;
 
-        r.m[0][0] = cos(radians);
-        r.m[0][2] = -sin(radians);
-        r.m[2][0] = sin(radians);
-        r.m[2][2] = cos(radians);
+        SinCos const sc = sincos(radians);
+
+        r.m[0][0] = sc.cos;
+        r.m[0][2] = -sc.sin;
+        r.m[2][0] = sc.sin;
+        r.m[2][2] = sc.cos;
 
         return r;
     }
@@ -561,15 +923,141 @@ public:
     {
         mat4 r;
 
-        r.m[0][0] = cos(radians);
-        r.m[0][1] = sin(radians);
-        r.m[1][0] = -sin(radians);
-        r.m[1][1] = cos(radians);
+        SinCos const sc = sincos(radians);
+
+        r.m[0][0] = sc.cos;
+        r.m[0][1] = sc.sin;
+        r.m[1][0] = -sc.sin;
+        r.m[1][1] = sc.cos;
+
+        return r;
+    }
+};
+
+//axis aligned box, min <= max on every axis
+class aabb
+{
+public:
+    vec3 min;
+    vec3 max;
+
+    [[nodiscard]] constexpr auto center() const -> vec3
+    {
+        return {(min.x + max.x) * 0.5_fx, (min.y + max.y) * 0.5_fx, (min.z + max.z) * 0.5_fx};
+    }
+
+    //bounds of packed xyz positions, e.g. the output of util::createCube
+    template<auto SIZE>
+    static constexpr auto fromPoints(ffr::util::array<fixed32, SIZE> const & xyz) -> aabb
+    {
+        static_assert((SIZE >= 3) && (SIZE % 3 == 0), "positions are packed xyz triples");
+
+        aabb r{{xyz[0], xyz[1], xyz[2]}, {xyz[0], xyz[1], xyz[2]}};
+        for(decltype(SIZE) i = 3; i < SIZE; i = i + 3)
+        {
+            r.min.x = (xyz[i + 0] < r.min.x) ? xyz[i + 0] : r.min.x;
+            r.min.y = (xyz[i + 1] < r.min.y) ? xyz[i + 1] : r.min.y;
+            r.min.z = (xyz[i + 2] < r.min.z) ? xyz[i + 2] : r.min.z;
+            r.max.x = (xyz[i + 0] > r.max.x) ? xyz[i + 0] : r.max.x;
+            r.max.y = (xyz[i + 1] > r.max.y) ? xyz[i + 1] : r.max.y;
+            r.max.z = (xyz[i + 2] > r.max.z) ? xyz[i + 2] : r.max.z;
+        }
+        return r;
+    }
+};
+
+class sphere
+{
+public:
+    vec3 center;
+    fixed32 radius;
 
+    //centred on the points' box, radius rounded up so every point is inside
+    template<auto SIZE>
+    static constexpr auto fromPoints(ffr::util::array<fixed32, SIZE> const & xyz) -> sphere
+    {
+        sphere r{aabb::fromPoints(xyz).center(), 0.0_fx};
+        for(decltype(SIZE) i = 0; i < SIZE; i = i + 3)
+        {
+            vec3 d{xyz[i + 0], xyz[i + 1], xyz[i + 2]};
+            fixed32 const l = (d - r.center).length() + fixed32::fromRaw(1);
+            r.radius = (l > r.radius) ? l : r.radius;
+        }
         return r;
     }
 };
 
+enum class Containment : uint8_t
+{
+    Outside,
+    Intersecting,
+    Inside
+};
+
+//the clip volume of a projection * modelview as six planes in the space the
+//matrix maps from, inside where x*p.x + y*p.y + z*p.z + p.w >= 0. these are
+//the same inequalities the clipper tests, so a bound classified Inside
+//needs no clipping. planes are not normalised
+class frustum
+{
+public:
+    vec4 planes[6];     //left, right, bottom, top, near, far
+
+    static constexpr auto fromMatrix(mat4 const & m) -> frustum
+    {
+        //clip.x = column 0 . v and so on, the planes are w +- x, w +- y, w +- z
+        frustum f;
+        for(uint8_t c = 0; c < 3; ++c)
+        {
+            f.planes[c * 2 + 0] = {m.m[0][3] + m.m[0][c], m.m[1][3] + m.m[1][c], m.m[2][3] + m.m[2][c], m.m[3][3] + m.m[3][c]};
+            f.planes[c * 2 + 1] = {m.m[0][3] - m.m[0][c], m.m[1][3] - m.m[1][c], m.m[2][3] - m.m[2][c], m.m[3][3] - m.m[3][c]};
+        }
+        return f;
+    }
+
+    //Outside only when the whole box is behind one plane. boxes within a
+    //small margin of a plane count as Intersecting so rounding in the vertex
+    //transform cannot push an unclipped vertex out
+    [[nodiscard]] constexpr auto classify(aabb const & box) const -> Containment
+    {
+        Containment r = Containment::Inside;
+        for(vec4 const & p : planes)
+        {
+            //the corners furthest along and against the plane normal
+            fixed64 const furthest = fixed64(p.w)
+                                   + fixed64::product(p.x, (p.x > 0.0_fx) ? box.max.x : box.min.x)
+                                   + fixed64::product(p.y, (p.y > 0.0_fx) ? box.max.y : box.min.y)
+                                   + fixed64::product(p.z, (p.z > 0.0_fx) ? box.max.z : box.min.z);
+            fixed64 const nearest = fixed64(p.w)
+                                  + fixed64::product(p.x, (p.x > 0.0_fx) ? box.min.x : box.max.x)
+                                  + fixed64::product(p.y, (p.y > 0.0_fx) ? box.min.y : box.max.y)
+                                  + fixed64::product(p.z, (p.z > 0.0_fx) ? box.min.z : box.max.z);
+            if(furthest < fixed64::fromRaw(-MARGIN)) { return Containment::Outside; }
+            if(nearest < fixed64::fromRaw(MARGIN)) { r = Containment::Intersecting; }
+        }
+        return r;
+    }
+
+    [[nodiscard]] constexpr auto classify(sphere const & s) const -> Containment
+    {
+        Containment r = Containment::Inside;
+        for(vec4 const & p : planes)
+        {
+            fixed64 const distance = fixed64(p.w) + fixed64::product(p.x, s.center.x)
+                                   + fixed64::product(p.y, s.center.y) + fixed64::product(p.z, s.center.z);
+            //the normal's length rounded up, so reach is never short
+            fixed32 const normal = vec3{p.x, p.y, p.z}.length() + fixed32::fromRaw(2);
+            fixed64 const reach = fixed64::product(s.radius, normal);
+            if(distance + reach < fixed64::fromRaw(-MARGIN)) { return Containment::Outside; }
+            if(distance - reach < fixed64::fromRaw(MARGIN)) { r = Containment::Intersecting; }
+        }
+        return r;
+    }
+
+private:
+    static constexpr int64_t MARGIN = int64_t(1) << 20;    //2^-12 in 32.32
+};
+
 auto mix(auto x, auto y, auto a) -> auto
 {
     return x * (1.0_fx - a) + y * a;
@@ -0,0 +1,333 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+
+#include "ffrmath.hpp"
+#include "util.hpp"
+
+//procedural meshes built entirely at compile time. every generator is
+//consteval and returns an IndexedMesh whose arrays can be stored in a
+//constexpr variable, so the vertices, indices, normals and bounds live in
+//the binary and nothing runs at startup:
+//
+//  constexpr auto ball = ffr::util::createSphere<16, 8>(1.0_fx);
+//  ctx.setVertexPointer(3, ball.positions.data());
+//  ctx.drawElements(ffr::DrawType::Triangles, 0, ball.indexCount(), ball.indices.data());
+//
+//triangles wind counter clockwise seen from outside, as createCube does
+
+namespace ffr::util
+{
+
+//an indexed triangle list with packed xyz positions, one colour per
+//triangle is expected when it is drawn
+template<uint16_t VERTICES, uint16_t INDICES>
+class IndexedMesh
+{
+    static_assert((INDICES >= 3) && (INDICES % 3 == 0), "indices form whole triangles");
+
+public:
+    array<math::fixed32, VERTICES * 3> positions;
+    array<math::fixed32, VERTICES * 3> normals;     //unit length, area weighted over the faces using the vertex
+    array<uint16_t, INDICES> indices;
+    math::aabb bounds;
+    math::sphere bounding_sphere;
+
+    constexpr auto vertexCount() const -> uint16_t
+    {
+        return VERTICES;
+    }
+
+    constexpr auto indexCount() const -> uint16_t
+    {
+        return INDICES;
+    }
+
+    constexpr auto triangleCount() const -> uint16_t
+    {
+        return INDICES / 3;
+    }
+};
+
+namespace
+{
+
+consteval auto magnitude(int64_t const v) -> uint64_t
+{
+    return (v < 0) ? (uint64_t(0) - uint64_t(v)) : uint64_t(v);
+}
+
+//to of steps across a span of length, exact to the raw unit
+consteval auto step(math::fixed32 const length, uint16_t const to, uint16_t const steps) -> math::fixed32
+{
+    return math::fixed32::fromRaw(int32_t((int64_t(length.raw()) * to) / steps));
+}
+
+//sums the face normals at each vertex wide, then scales every sum so its
+//largest component is near 1 before normalising, which keeps tiny and huge
+//meshes equally precise
+template<uint16_t VERTICES, uint16_t INDICES>
+consteval auto finish(IndexedMesh<VERTICES, INDICES> & mesh) -> void
+{
+    array<int64_t, VERTICES * 3> sums;
+    for(uint16_t i = 0; i < INDICES; i = i + 3)
+    {
+        auto const corner = [&](uint16_t const k) -> math::vec3 {
+            uint16_t const v = mesh.indices[i + k] * 3;
+            return {mesh.positions[v], mesh.positions[v + 1], mesh.positions[v + 2]};
+        };
+        math::vec3 const p0 = corner(0);
+        math::vec3 const e1 = corner(1) - p0;
+        math::vec3 const e2 = corner(2) - p0;
+
+        int64_t const n[3] =
+        {
+            (math::fixed64::product(e1.y, e2.z) - math::fixed64::product(e1.z, e2.y)).raw(),
+            (math::fixed64::product(e1.z, e2.x) - math::fixed64::product(e1.x, e2.z)).raw(),
+            (math::fixed64::product(e1.x, e2.y) - math::fixed64::product(e1.y, e2.x)).raw(),
+        };
+        for(uint16_t k = 0; k < 3; ++k)
+        {
+            for(uint16_t c = 0; c < 3; ++c)
+            {
+                sums[(mesh.indices[i + k] * 3) + c] += n[c];
+            }
+        }
+    }
+
+    for(uint16_t v = 0; v < VERTICES * 3; v = v + 3)
+    {
+        uint64_t const largest = std::max({magnitude(sums[v]), magnitude(sums[v + 1]), magnitude(sums[v + 2])});
+        if(largest == 0) { continue; }
+
+        int const shift = int(std::bit_width(largest)) - 16;
+        auto const scaled = [shift](int64_t const s) -> math::fixed32 {
+            return math::fixed32::fromRaw(int32_t((shift > 0) ? (s >> shift) : (s * (int64_t(1) << -shift))));
+        };
+        math::vec3 const n{scaled(sums[v]), scaled(sums[v + 1]), scaled(sums[v + 2])};
+        math::fixed32 const length = n.length();
+        mesh.normals[v] = n.x / length;
+        mesh.normals[v + 1] = n.y / length;
+        mesh.normals[v + 2] = n.z / length;
+    }
+
+    mesh.bounds = math::aabb::fromPoints(mesh.positions);
+    mesh.bounding_sphere = math::sphere::fromPoints(mesh.positions);
+}
+
+template<auto SIZE>
+consteval auto same_position(array<math::fixed32, SIZE> const & xyz, uint16_t const a, uint16_t const b) -> bool
+{
+    return (xyz[a * 3] == xyz[b * 3]) && (xyz[(a * 3) + 1] == xyz[(b * 3) + 1]) && (xyz[(a * 3) + 2] == xyz[(b * 3) + 2]);
+}
+
+template<auto SIZE>
+consteval auto unique_positions(array<math::fixed32, SIZE> const & xyz) -> uint16_t
+{
+    uint16_t unique = 0;
+    for(uint16_t i = 0; i < SIZE / 3; ++i)
+    {
+        bool seen = false;
+        for(uint16_t j = 0; (j < i) && (!seen); ++j)
+        {
+            seen = same_position(xyz, i, j);
+        }
+        unique += seen ? 0 : 1;
+    }
+    return unique;
+}
+
+}
+
+//indexes a triangle soup of packed xyz positions, merging vertices with
+//identical positions. MAKE returns the soup, e.g.
+//  constexpr auto box = weld<[] { return createCube(1.0_fx, 1.0_fx, 1.0_fx); }>();
+template<auto MAKE>
+consteval auto weld()
+{
+    constexpr auto soup = MAKE();
+    constexpr uint16_t VERTICES = unique_positions(soup);
+    constexpr uint16_t INDICES = soup.size() / 3;
+
+    IndexedMesh<VERTICES, INDICES> r;
+    uint16_t unique = 0;
+    for(uint16_t i = 0; i < INDICES; ++i)
+    {
+        uint16_t j = 0;
+        while((j < unique) && !((r.positions[j * 3] == soup[i * 3]) && (r.positions[(j * 3) + 1] == soup[(i * 3) + 1])
+                                && (r.positions[(j * 3) + 2] == soup[(i * 3) + 2])))
+        {
+            ++j;
+        }
+        if(j == unique)
+        {
+            r.positions[j * 3] = soup[i * 3];
+            r.positions[(j * 3) + 1] = soup[(i * 3) + 1];
+            r.positions[(j * 3) + 2] = soup[(i * 3) + 2];
+            unique++;
+        }
+        r.indices[i] = j;
+    }
+    finish(r);
+    return r;
+}
+
+//uv sphere around the origin with SLICES segments around y and STACKS from
+//pole to pole. the poles are single vertices and the seam is shared
+template<uint16_t SLICES, uint16_t STACKS>
+consteval auto createSphere(math::fixed32 const radius)
+    -> IndexedMesh<2 + ((STACKS - 1) * SLICES), 6 * SLICES * (STACKS - 1)>
+{
+    static_assert((SLICES >= 3) && (STACKS >= 2), "a sphere needs at least 3 slices and 2 stacks");
+
+    IndexedMesh<2 + ((STACKS - 1) * SLICES), 6 * SLICES * (STACKS - 1)> r;
+    constexpr uint16_t BOTTOM = 1 + ((STACKS - 1) * SLICES);
+    auto const ring = [](uint16_t const stack, uint16_t const slice) -> uint16_t {
+        return 1 + ((stack - 1) * SLICES) + (slice % SLICES);
+    };
+
+    r.positions[1] = radius;
+    r.positions[(BOTTOM * 3) + 1] = -radius;
+    for(uint16_t stack = 1; stack < STACKS; ++stack)
+    {
+        math::SinCos const phi = math::sincos(step(math::PI, stack, STACKS));
+        for(uint16_t slice = 0; slice < SLICES; ++slice)
+        {
+            math::SinCos const theta = math::sincos(step(math::TAU, slice, SLICES));
+            uint16_t const v = ring(stack, slice) * 3;
+            r.positions[v] = radius * phi.sin * theta.cos;
+            r.positions[v + 1] = radius * phi.cos;
+            r.positions[v + 2] = -(radius * phi.sin * theta.sin);
+        }
+    }
+
+    uint16_t i = 0;
+    auto const triangle = [&](uint16_t const a, uint16_t const b, uint16_t const c) {
+        r.indices[i] = a;
+        r.indices[i + 1] = b;
+        r.indices[i + 2] = c;
+        i = i + 3;
+    };
+    for(uint16_t slice = 0; slice < SLICES; ++slice)
+    {
+        triangle(0, ring(1, slice), ring(1, slice + 1));
+        for(uint16_t stack = 1; stack + 1 < STACKS; ++stack)
+        {
+            triangle(ring(stack, slice), ring(stack + 1, slice), ring(stack + 1, slice + 1));
+            triangle(ring(stack, slice), ring(stack + 1, slice + 1), ring(stack, slice + 1));
+        }
+        triangle(BOTTOM, ring(STACKS - 1, slice + 1), ring(STACKS - 1, slice));
+    }
+
+    finish(r);
+    return r;
+}
+
+//COLUMNS x ROWS quads in the xz plane centred on the origin and facing +y,
+//with vertex heights from height(column, row). a terrain patch when the
+//heights come from a heightmap
+template<uint16_t COLUMNS, uint16_t ROWS, class HEIGHT>
+consteval auto createGrid(math::fixed32 const width, math::fixed32 const depth, HEIGHT height)
+    -> IndexedMesh<(COLUMNS + 1) * (ROWS + 1), 6 * COLUMNS * ROWS>
+{
+    static_assert((COLUMNS >= 1) && (ROWS >= 1), "a grid needs at least one quad");
+
+    IndexedMesh<(COLUMNS + 1) * (ROWS + 1), 6 * COLUMNS * ROWS> r;
+    auto const vertex = [](uint16_t const column, uint16_t const row) -> uint16_t {
+        return (row * (COLUMNS + 1)) + column;
+    };
+
+    for(uint16_t row = 0; row <= ROWS; ++row)
+    {
+        for(uint16_t column = 0; column <= COLUMNS; ++column)
+        {
+            uint16_t const v = vertex(column, row) * 3;
+            r.positions[v] = step(width, column, COLUMNS) - (width * 0.5_fx);
+            r.positions[v + 1] = height(column, row);
+            r.positions[v + 2] = step(depth, row, ROWS) - (depth * 0.5_fx);
+        }
+    }
+
+    uint16_t i = 0;
+    for(uint16_t row = 0; row < ROWS; ++row)
+    {
+        for(uint16_t column = 0; column < COLUMNS; ++column)
+        {
+            uint16_t const quad[4] = {vertex(column, row), vertex(column, row + 1),
+                                      vertex(column + 1, row + 1), vertex(column + 1, row)};
+            uint16_t const order[6] = {0, 1, 2, 0, 2, 3};
+            for(uint16_t k = 0; k < 6; ++k)
+            {
+                r.indices[i + k] = quad[order[k]];
+            }
+            i = i + 6;
+        }
+    }
+
+    finish(r);
+    return r;
+}
+
+template<uint16_t COLUMNS, uint16_t ROWS>
+consteval auto createGrid(math::fixed32 const width, math::fixed32 const depth)
+{
+    return createGrid<COLUMNS, ROWS>(width, depth, [](uint16_t, uint16_t) { return 0.0_fx; });
+}
+
+//capped cylinder around the y axis from -half_height to half_height. the
+//caps have rims of their own, so the hard edge keeps radial normals on the
+//sides and vertical ones on the caps
+template<uint16_t SLICES>
+consteval auto createCylinder(math::fixed32 const radius, math::fixed32 const half_height)
+    -> IndexedMesh<(4 * SLICES) + 2, 12 * SLICES>
+{
+    static_assert(SLICES >= 3, "a cylinder needs at least 3 slices");
+
+    IndexedMesh<(4 * SLICES) + 2, 12 * SLICES> r;
+    constexpr uint16_t SIDE_TOP = 0;
+    constexpr uint16_t SIDE_BOTTOM = 1;
+    constexpr uint16_t CAP_TOP = 2;
+    constexpr uint16_t CAP_BOTTOM = 3;
+    constexpr uint16_t TOP = 4 * SLICES;
+    constexpr uint16_t BOTTOM = TOP + 1;
+    auto const rim = [](uint16_t const slice, uint16_t const ring) -> uint16_t {
+        return (slice % SLICES) + (ring * SLICES);
+    };
+
+    r.positions[(TOP * 3) + 1] = half_height;
+    r.positions[(BOTTOM * 3) + 1] = -half_height;
+    for(uint16_t slice = 0; slice < SLICES; ++slice)
+    {
+        math::SinCos const theta = math::sincos(step(math::TAU, slice, SLICES));
+        for(uint16_t ring = 0; ring < 4; ++ring)
+        {
+            bool const bottom = (ring == SIDE_BOTTOM) || (ring == CAP_BOTTOM);
+            uint16_t const v = rim(slice, ring) * 3;
+            r.positions[v] = radius * theta.cos;
+            r.positions[v + 1] = bottom ? -half_height : half_height;
+            r.positions[v + 2] = -(radius * theta.sin);
+        }
+    }
+
+    uint16_t i = 0;
+    auto const triangle = [&](uint16_t const a, uint16_t const b, uint16_t const c) {
+        r.indices[i] = a;
+        r.indices[i + 1] = b;
+        r.indices[i + 2] = c;
+        i = i + 3;
+    };
+    for(uint16_t slice = 0; slice < SLICES; ++slice)
+    {
+        triangle(rim(slice, SIDE_TOP), rim(slice, SIDE_BOTTOM), rim(slice + 1, SIDE_BOTTOM));
+        triangle(rim(slice, SIDE_TOP), rim(slice + 1, SIDE_BOTTOM), rim(slice + 1, SIDE_TOP));
+        triangle(TOP, rim(slice, CAP_TOP), rim(slice + 1, CAP_TOP));
+        triangle(BOTTOM, rim(slice + 1, CAP_BOTTOM), rim(slice, CAP_BOTTOM));
+    }
+
+    finish(r);
+    return r;
+}
+
+}
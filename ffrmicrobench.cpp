@@ -0,0 +1,565 @@
+#include "ffrmath.hpp"
+#include "ffr.hpp"
+#include "ffrframebuffer.hpp"
+#include "ffrtrace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// usage: ffrmicrobench [--json] [--repeat N] [--filter TEXT] [--trace FILE]...
+//   --json      print results as JSON on stdout instead of a table
+//   --repeat N  timed samples per benchmark, after one warm-up sample
+//   --filter    only run benchmarks whose name contains TEXT
+//   --trace     also replay a captured draw trace (see ffrtrace.hpp), timed
+//               per frame including clear()
+
+namespace
+{
+
+constexpr uint32_t INPUT_COUNT = 4096;
+constexpr uint16_t SCREEN_WIDTH = 240;
+constexpr uint16_t SCREEN_HEIGHT = 160;
+
+ffr::math::fixed32 inputs[INPUT_COUNT];
+ffr::math::fixed32 angles[INPUT_COUNT];
+ffr::math::vec4 clip_verts[INPUT_COUNT];
+ffr::math::mat4 matrices[INPUT_COUNT];
+ffr::math::vec4 clip_triangles[INPUT_COUNT][3];
+ffr::math::vec2 screen_triangles[INPUT_COUNT][3];
+
+// keeps the optimiser from discarding the measured work
+volatile int32_t sink = 0;
+
+class Options
+{
+public:
+    bool json = false;
+    uint32_t repeats = 11;
+    char const * filter = nullptr;
+    std::vector<char const *> traces;
+};
+
+class Result
+{
+public:
+    std::string name;
+    char const * unit = "ns/op";
+    uint64_t ops_per_sample = 0;
+    double min = 0.0;
+    double median = 0.0;
+    double mean = 0.0;
+    double stddev = 0.0;
+};
+
+class Accuracy
+{
+public:
+    char const * name = "";
+    double max_ulp = 0.0;
+    double mean_ulp = 0.0;
+};
+
+Options options;
+std::vector<Result> results;
+std::vector<Accuracy> accuracies;
+
+// exposes the clipper and culling test to the benchmarks
+class BenchContext : public ffr::Context<128>
+{
+public:
+    using ffr::Context<128>::clip_triangle;
+    using ffr::Context<128>::frontFacing;
+    using ffr::Context<128>::clip_winding;
+
+    auto plot(uint16_t, uint16_t, uint16_t) -> void override {}
+};
+
+// line() and triangle() draw into a real 555 framebuffer
+class RasterContext : public ffr::FramebufferContext<128, SCREEN_WIDTH, SCREEN_HEIGHT, 1>
+{
+public:
+    // the snapped-triangle triage on the framebuffer's own writer
+    auto rasterTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color) -> void
+    {
+        withWriter([&](auto & writer) {
+            raster_triangle(writer, x0, y0, x1, y1, x2, y2, color);
+        });
+    }
+};
+RasterContext * raster = nullptr;
+
+// the same framebuffer with additive blending compiled in
+using AddRasterContext = ffr::FramebufferContext<128, SCREEN_WIDTH, SCREEN_HEIGHT, 1, uint16_t, ffr::FixedBlend<ffr::BlendMode::Add>>;
+AddRasterContext * add_raster = nullptr;
+
+auto toFloat(ffr::math::fixed32 const f) -> float
+{
+    return static_cast<float>(f.raw()) / 65536.0f;
+}
+
+auto fromFloat(float const f) -> ffr::math::fixed32
+{
+    return ffr::math::fixed32::fromRaw(static_cast<int32_t>(f * 65536.0f));
+}
+
+auto random(uint32_t &seed) -> uint32_t
+{
+    seed = seed * 1664525u + 1013904223u;
+    return seed;
+}
+
+auto selected(char const * const name) -> bool
+{
+    return (!options.filter) || std::strstr(name, options.filter);
+}
+
+// summarises the timed samples of one benchmark
+auto report(std::string const & name, char const * const unit, uint64_t const ops, std::vector<double> & samples) -> void
+{
+    std::sort(samples.begin(), samples.end());
+    Result res;
+    res.name = name;
+    res.unit = unit;
+    res.ops_per_sample = ops;
+    res.min = samples.front();
+    res.median = samples[samples.size() / 2];
+    for (double const ns : samples) { res.mean += ns; }
+    res.mean /= double(samples.size());
+    for (double const ns : samples) { res.stddev += (ns - res.mean) * (ns - res.mean); }
+    res.stddev = std::sqrt(res.stddev / double(samples.size()));
+    results.push_back(res);
+
+    if (!options.json)
+    {
+        std::printf("%-28s %10.3f %10.3f %10.3f %8.3f\n", res.name.c_str(), res.min, res.median, res.mean, res.stddev);
+    }
+}
+
+// f(i, r) runs one operation on input i during round r and returns a raw result.
+// a sample is rounds x INPUT_COUNT operations; one warm-up sample is discarded
+template<class FUNC>
+auto bench(char const * const name, uint32_t const rounds, FUNC f) -> void
+{
+    if (!selected(name)) { return; }
+
+    std::vector<double> samples;
+    int32_t acc = 0;
+    for (uint32_t s = 0; s <= options.repeats; ++s)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        for (uint32_t r = 0; r < rounds; ++r)
+        {
+            for (uint32_t i = 0; i < INPUT_COUNT; ++i)
+            {
+                acc += f(i, r + (s * rounds));
+            }
+        }
+        auto const end = std::chrono::steady_clock::now();
+        if (s > 0)
+        {
+            samples.push_back(std::chrono::duration<double, std::nano>(end - start).count() / (double(rounds) * INPUT_COUNT));
+        }
+    }
+    sink = acc;
+
+    report(name, "ns/op", uint64_t(rounds) * INPUT_COUNT, samples);
+}
+
+// scalar kernels, the round perturbs the input so the loop cannot be hoisted
+template<class FUNC>
+auto benchScalar(char const * const name, FUNC f) -> void
+{
+    bench(name, 256, [&](uint32_t const i, uint32_t const r) {
+        return f(ffr::math::fixed32::fromRaw(inputs[i].raw() + int32_t(r))).raw();
+    });
+}
+
+template<class FUNC>
+auto benchBinary(char const * const name, FUNC f) -> void
+{
+    bench(name, 256, [&](uint32_t const i, uint32_t const r) {
+        ffr::math::fixed32 const a = ffr::math::fixed32::fromRaw(inputs[i].raw() + int32_t(r));
+        return f(a, inputs[(i + 1) % INPUT_COUNT]).raw();
+    });
+}
+
+// worst absolute error in ulp of a w-divide kernel against the exact quotient
+template<class FUNC>
+auto accuracy(char const * const name, FUNC f) -> void
+{
+    if (!selected(name)) { return; }
+
+    double worst = 0.0;
+    double total = 0.0;
+    for (auto const &v : clip_verts)
+    {
+        ffr::math::vec4 const n = f(v);
+        double const w = v.w.raw();
+        double const errs[3] = {std::fabs(n.x.raw() - (v.x.raw() * 65536.0) / w),
+                                std::fabs(n.y.raw() - (v.y.raw() * 65536.0) / w),
+                                std::fabs(n.z.raw() - (v.z.raw() * 65536.0) / w)};
+        for (double const e : errs)
+        {
+            worst = (e > worst) ? e : worst;
+            total += e;
+        }
+    }
+    accuracies.push_back({name, worst, total / (3.0 * INPUT_COUNT)});
+
+    if (!options.json)
+    {
+        std::printf("%-28s max %.3f ulp, mean %.3f ulp\n", name, worst, total / (3.0 * INPUT_COUNT));
+    }
+}
+
+auto divideW(ffr::math::vec4 v) -> ffr::math::vec4
+{
+    v.x = v.x / v.w;
+    v.y = v.y / v.w;
+    v.z = v.z / v.w;
+    return v;
+}
+
+auto reciprocalW(ffr::math::vec4 v) -> ffr::math::vec4
+{
+    ffr::math::recip32 const inv_w(v.w);
+    v.x = v.x * inv_w;
+    v.y = v.y * inv_w;
+    v.z = v.z * inv_w;
+    return v;
+}
+
+// a coordinate in [-3w, 3w], so most triangles cross several clip planes
+auto outside(uint32_t &seed, int32_t const w) -> ffr::math::fixed32
+{
+    return ffr::math::fixed32::fromRaw(int32_t(int64_t(random(seed) % (6u * w)) - 3 * int64_t(w)));
+}
+
+// screen position so a primitive of the given extent stays on screen
+auto screenPos(uint32_t const seed, uint16_t const range, uint16_t const extent) -> int16_t
+{
+    return int16_t(seed % uint32_t(range - extent));
+}
+
+auto benchLine(char const * const name, uint16_t const length) -> void
+{
+    bench(name, 16, [length](uint32_t const i, uint32_t const r) {
+        uint32_t const h = (i * 2654435761u) ^ r;
+        int16_t const x = screenPos(h, SCREEN_WIDTH, length);
+        int16_t const y = screenPos(h >> 16, SCREEN_HEIGHT, length);
+        // alternate shallow and steep lines
+        int16_t const dx = (i & 1) ? int16_t(length) : int16_t(length / 3);
+        int16_t const dy = (i & 1) ? int16_t(length / 3) : int16_t(length);
+        raster->line(x, y, int16_t(x + dx), int16_t(y + dy), uint16_t(i));
+        return int32_t(raster->pixels()[i]);
+    });
+}
+
+template<class CONTEXT = RasterContext>
+auto benchTriangle(char const * const name, uint16_t const size, uint32_t const rounds, CONTEXT * const target = raster) -> void
+{
+    bench(name, rounds, [size, target](uint32_t const i, uint32_t const r) {
+        uint32_t const h = (i * 2654435761u) ^ r;
+        int16_t const x = screenPos(h, SCREEN_WIDTH, size);
+        int16_t const y = screenPos(h >> 16, SCREEN_HEIGHT, size);
+        int16_t const s = int16_t(size);
+        target->triangle(x, y, int16_t(x + s), int16_t(y + (s / 3)), int16_t(x + (s / 4)), int16_t(y + s), uint16_t(i));
+        return int32_t(target->pixels()[i]);
+    });
+}
+
+// the snapped-triangle triage, size 0 lands on one pixel and 1 on a 2x2 quad
+auto benchTinyTriangle(char const * const name, int16_t const size) -> void
+{
+    bench(name, 256, [size](uint32_t const i, uint32_t const r) {
+        uint32_t const h = (i * 2654435761u) ^ r;
+        int16_t const x = screenPos(h, SCREEN_WIDTH, 2);
+        int16_t const y = screenPos(h >> 16, SCREEN_HEIGHT, 2);
+        raster->rasterTriangle(x, y, int16_t(x + size), y, x, int16_t(y + size), uint16_t(i));
+        return int32_t(raster->pixels()[i]);
+    });
+}
+
+// replays every frame of a captured trace into the raster context. the
+// sample unit is one frame
+auto benchTrace(char const * const path) -> void
+{
+    std::string name = path;
+    name = "trace " + name.substr(name.find_last_of("/\\") + 1);
+    if (!selected(name.c_str())) { return; }
+
+    std::vector<uint8_t> bytes;
+    if (FILE * const f = std::fopen(path, "rb"))
+    {
+        uint8_t buf[4096];
+        for (size_t n = 0; (n = std::fread(buf, 1, sizeof(buf), f)) > 0;)
+        {
+            bytes.insert(bytes.end(), buf, buf + n);
+        }
+        std::fclose(f);
+    }
+
+    ffr::TracePlayer player;
+    if (!player.load(bytes.data(), bytes.size()) || (player.frameCount() == 0))
+    {
+        std::fprintf(stderr, "%s: not a readable trace\n", path);
+        return;
+    }
+
+    std::vector<double> samples;
+    for (uint32_t s = 0; s <= options.repeats; ++s)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        for (uint32_t frame = 0; frame < player.frameCount(); ++frame)
+        {
+            raster->clear();
+            player.replayFrame(*raster, frame);
+        }
+        auto const end = std::chrono::steady_clock::now();
+        if (s > 0)
+        {
+            samples.push_back(std::chrono::duration<double, std::nano>(end - start).count() / player.frameCount());
+        }
+    }
+    sink = int32_t(raster->pixels()[0]);
+    raster->setBlendMode(ffr::BlendMode::Opaque);
+
+    report(name, "ns/frame", player.frameCount(), samples);
+}
+
+auto printJson() -> void
+{
+    std::printf("{\n  \"repeats\": %u,\n  \"profile\": %d,\n  \"compiler\": \"%s\",\n", options.repeats, FFR_PROFILE, __VERSION__);
+    std::printf("  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        Result const & r = results[i];
+        std::printf("    {\"name\": \"%s\", \"ops_per_sample\": %llu, \"unit\": \"%s\", "
+                    "\"min\": %.4f, \"median\": %.4f, \"mean\": %.4f, \"stddev\": %.4f}%s\n",
+                    r.name.c_str(), static_cast<unsigned long long>(r.ops_per_sample), r.unit,
+                    r.min, r.median, r.mean, r.stddev, (i + 1 < results.size()) ? "," : "");
+    }
+    std::printf("  ],\n  \"accuracy\": [\n");
+    for (size_t i = 0; i < accuracies.size(); ++i)
+    {
+        Accuracy const & a = accuracies[i];
+        std::printf("    {\"name\": \"%s\", \"max_ulp\": %.4f, \"mean_ulp\": %.4f}%s\n",
+                    a.name, a.max_ulp, a.mean_ulp, (i + 1 < accuracies.size()) ? "," : "");
+    }
+    std::printf("  ]\n}\n");
+}
+
+auto parseOptions(int argc, char *argv[]) -> bool
+{
+    for (int a = 1; a < argc; ++a)
+    {
+        if (std::strcmp(argv[a], "--json") == 0)
+        {
+            options.json = true;
+        }
+        else if ((std::strcmp(argv[a], "--repeat") == 0) && (a + 1 < argc))
+        {
+            long const n = std::strtol(argv[++a], nullptr, 10);
+            options.repeats = (n > 0) ? uint32_t(n) : 1;
+        }
+        else if ((std::strcmp(argv[a], "--filter") == 0) && (a + 1 < argc))
+        {
+            options.filter = argv[++a];
+        }
+        else if ((std::strcmp(argv[a], "--trace") == 0) && (a + 1 < argc))
+        {
+            options.traces.push_back(argv[++a]);
+        }
+        else
+        {
+            std::fprintf(stderr, "usage: %s [--json] [--repeat N] [--filter TEXT] [--trace FILE]...\n", argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+auto main(int argc, char *argv[]) -> int
+{
+    if (!parseOptions(argc, argv)) { return 1; }
+
+    uint32_t seed = 0x12345678u;
+
+    // spread inputs over [2^-8, 2^14] so every normalisation shift is exercised
+    for (auto &in : inputs)
+    {
+        in = ffr::math::fixed32::fromRaw(int32_t(256 + (random(seed) >> 2) % (int32_t(1) << 30)));
+    }
+
+    // angles over several turns, positive and negative
+    for (auto &a : angles)
+    {
+        a = ffr::math::fixed32::fromRaw(int32_t(random(seed) % (40u << 16)) - (20 << 16));
+    }
+
+    // post-clip vertices: w in [1, 1000) with x, y, z inside [-w, w]
+    for (auto &v : clip_verts)
+    {
+        int32_t const w = int32_t(65536 + random(seed) % (999u << 16));
+        v.w = ffr::math::fixed32::fromRaw(w);
+        v.x = ffr::math::fixed32::fromRaw(int32_t(int64_t(random(seed) % (2u * w)) - w));
+        v.y = ffr::math::fixed32::fromRaw(int32_t(int64_t(random(seed) % (2u * w)) - w));
+        v.z = ffr::math::fixed32::fromRaw(int32_t(int64_t(random(seed) % (2u * w)) - w));
+    }
+
+    // affine model matrices: rotation about two axes plus a translation
+    for (auto &m : matrices)
+    {
+        auto const angle = ffr::math::fixed32::fromRaw(int32_t(random(seed) % (7u << 16)));
+        m = ffr::math::mat4::rotationY(angle) * ffr::math::mat4::rotationX(angle);
+        m.m[3][0] = ffr::math::fixed32::fromRaw(int32_t(random(seed) % (64u << 16)));
+        m.m[3][2] = -ffr::math::fixed32::fromRaw(int32_t(random(seed) % (64u << 16)));
+    }
+
+    // worst case for the clipper: keep only triangles that clip into at least
+    // five output triangles, which takes crossings of five or six planes
+    for (auto &t : clip_triangles)
+    {
+        ffr::util::array<ffr::math::vec4, 27> out;
+        do
+        {
+            for (auto &v : t)
+            {
+                int32_t const w = int32_t(65536 + random(seed) % (99u << 16));
+                v = {outside(seed, w), outside(seed, w), outside(seed, w), ffr::math::fixed32::fromRaw(w)};
+            }
+        } while (BenchContext::clip_triangle(t[0], t[1], t[2], out) < 15);
+    }
+
+    for (auto &t : screen_triangles)
+    {
+        for (auto &v : t)
+        {
+            v = {ffr::math::fixed32::fromRaw(int32_t(random(seed) % (SCREEN_WIDTH << 16))),
+                 ffr::math::fixed32::fromRaw(int32_t(random(seed) % (SCREEN_HEIGHT << 16)))};
+        }
+    }
+
+    raster = new RasterContext();
+    add_raster = new AddRasterContext();
+
+    if (!options.json)
+    {
+        std::printf("%-28s %10s %10s %10s %8s   (ns/op, traces ns/frame, %u samples)\n", "benchmark", "min", "median", "mean", "stddev", options.repeats);
+    }
+
+    using ffr::math::fixed32;
+    benchBinary("fixed32 +", [](fixed32 a, fixed32 b) { return a + b; });
+    benchBinary("fixed32 *", [](fixed32 a, fixed32 b) { return a * b; });
+    benchBinary("fixed32 /", [](fixed32 a, fixed32 b) { return a / b; });
+    benchBinary("fixed32 mulSat", [](fixed32 a, fixed32 b) { return a.mulSat(b); });
+    benchBinary("float *", [](fixed32 a, fixed32 b) { return fromFloat(toFloat(a) * toFloat(b)); });
+    benchBinary("float /", [](fixed32 a, fixed32 b) { return fromFloat(toFloat(a) / toFloat(b)); });
+
+    benchScalar("fixed32 sqrt", [](auto x) { return ffr::math::sqrt(x); });
+    benchScalar("float sqrt", [](auto x) { return fromFloat(std::sqrt(toFloat(x))); });
+
+    benchScalar("fixed32 reciprocal", [](auto x) { return ffr::math::reciprocal(x); });
+    benchScalar("fixed32 1/x divide", [](auto x) { return 1.0_fx / x; });
+    benchScalar("float reciprocal", [](auto x) { return fromFloat(1.0f / toFloat(x)); });
+
+    benchScalar("fixed32 rsqrt", [](auto x) { return ffr::math::rsqrt(x); });
+    benchScalar("float rsqrt", [](auto x) { return fromFloat(1.0f / std::sqrt(toFloat(x))); });
+
+    bench("sin", 256, [](uint32_t const i, uint32_t const r) {
+        return ffr::math::sin(fixed32::fromRaw(angles[i].raw() + int32_t(r))).raw();
+    });
+    bench("cos", 256, [](uint32_t const i, uint32_t const r) {
+        return ffr::math::cos(fixed32::fromRaw(angles[i].raw() + int32_t(r))).raw();
+    });
+    bench("sincos", 256, [](uint32_t const i, uint32_t const r) {
+        ffr::math::SinCos const sc = ffr::math::sincos(fixed32::fromRaw(angles[i].raw() + int32_t(r)));
+        return sc.sin.raw() + sc.cos.raw();
+    });
+    bench("float sinf", 256, [](uint32_t const i, uint32_t const r) {
+        return fromFloat(std::sin(toFloat(fixed32::fromRaw(angles[i].raw() + int32_t(r))))).raw();
+    });
+
+    // perspective divide: three operator/ against one recip32 and three multiplies
+    bench("w-divide 3x divide", 256, [](uint32_t const i, uint32_t const r) {
+        ffr::math::vec4 v = clip_verts[i];
+        v.w = fixed32::fromRaw(v.w.raw() + int32_t(r));
+        v = divideW(v);
+        return v.x.raw() + v.y.raw() + v.z.raw();
+    });
+    bench("w-divide recip32", 256, [](uint32_t const i, uint32_t const r) {
+        ffr::math::vec4 v = clip_verts[i];
+        v.w = fixed32::fromRaw(v.w.raw() + int32_t(r));
+        v = reciprocalW(v);
+        return v.x.raw() + v.y.raw() + v.z.raw();
+    });
+    bench("mat4 * vec4", 256, [](uint32_t const i, uint32_t const r) {
+        ffr::math::vec4 const v = matrices[i] * clip_verts[(i + r) % INPUT_COUNT];
+        return v.x.raw() + v.w.raw();
+    });
+    bench("mat4 * mat4", 64, [](uint32_t const i, uint32_t const r) {
+        ffr::math::mat4 const n = matrices[i] * matrices[(i + r) % INPUT_COUNT];
+        return n.m[0][0].raw() + n.m[3][2].raw();
+    });
+    bench("mat4 mulAffine", 64, [](uint32_t const i, uint32_t const r) {
+        ffr::math::mat4 const n = matrices[i].mulAffine(matrices[(i + r) % INPUT_COUNT]);
+        return n.m[0][0].raw() + n.m[3][2].raw();
+    });
+
+    bench("clip_triangle worst case", 16, [](uint32_t const i, uint32_t const r) {
+        ffr::util::array<ffr::math::vec4, 27> out;
+        ffr::math::vec4 const * const t = clip_triangles[(i + r) % INPUT_COUNT];
+        int const n = BenchContext::clip_triangle(t[0], t[1], t[2], out);
+        return n + out[0].x.raw();
+    });
+    bench("frontFacing", 256, [](uint32_t const i, uint32_t const r) {
+        ffr::math::vec2 const * const t = screen_triangles[(i + r) % INPUT_COUNT];
+        return int32_t(BenchContext::frontFacing(t[0], t[1], t[2]));
+    });
+    bench("clip_winding", 256, [](uint32_t const i, uint32_t const r) {
+        ffr::math::vec4 const * const t = clip_triangles[(i + r) % INPUT_COUNT];
+        return int32_t(BenchContext::clip_winding(t[0], t[1], t[2]));
+    });
+
+    benchLine("line 4px", 4);
+    benchLine("line 32px", 32);
+    benchLine("line 128px", 128);
+
+    benchTinyTriangle("raster_triangle 1px", 0);
+    benchTriangle("triangle 1px", 0, 256);
+    benchTinyTriangle("raster_triangle 2x2", 1);
+    benchTriangle("triangle 2x2", 1, 256);
+    benchTriangle("triangle 4px", 4, 16);
+    benchTriangle("triangle 32px", 32, 4);
+    benchTriangle("triangle 128px", 128, 1);
+
+    raster->setBlendMode(ffr::BlendMode::Add);
+    benchTriangle("triangle 32px add", 32, 4);
+    raster->setBlendMode(ffr::BlendMode::Opaque);
+    benchTriangle("triangle 32px add fixed", 32, 4, add_raster);
+
+    for (char const * const path : options.traces)
+    {
+        benchTrace(path);
+    }
+
+    accuracy("w-divide 3x divide", divideW);
+    accuracy("w-divide recip32", reciprocalW);
+
+    if (options.json)
+    {
+        printJson();
+    }
+
+    delete add_raster;
+    delete raster;
+    return 0;
+}
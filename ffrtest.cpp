@@ -1,4 +1,5 @@
 #include "ffr.hpp"
+#include "ffrframebuffer.hpp"
 #include "util.hpp"
 
 #include <SDL2/SDL.h>
@@ -21,58 +22,50 @@ uint16_t car[12] =
 
 auto const cv = ffr::util::createCube(1.0_fx, 1.0_fx, 1.0_fx);
 
-class SDL_Context : public ffr::Context<128>
+//converts finished frames in one pass and streams them to a texture. SDL
+//wants its renderer driven from the main thread, so this presents
+//synchronously rather than from the presenter thread
+class SDL_Presenter : public ffr::Presenter
 {
 public:
-    SDL_Context()
+    SDL_Presenter()
     {
         SDL_CreateWindowAndRenderer(240*4,160*4,0,&win,&ren);
-        SDL_RenderSetScale(ren, 4.0,4.0);
+        tex = SDL_CreateTexture(ren, SDL_PIXELFORMAT_RGB888, SDL_TEXTUREACCESS_STREAMING, 240, 160);
     }
 
-    ~SDL_Context()
+    ~SDL_Presenter()
     {
-
+        SDL_DestroyTexture(tex);
+        SDL_DestroyRenderer(ren);
+        SDL_DestroyWindow(win);
     }
 
-    void clear() override
+    void presentFrame(uint16_t const * pixels, uint16_t width, uint16_t height, ffr::DirtyRect const & dirty) override
     {
-        SDL_SetRenderDrawColor(ren,0,0,0,255);
-        SDL_RenderClear(ren);
-    }
+        (void)height;
 
-    void present() override
-    {
+        //the texture keeps its contents, so only the changed area is converted
+        SDL_Rect const rect{dirty.x0, dirty.y0, dirty.x1 - dirty.x0, dirty.y1 - dirty.y0};
+        void * dst = nullptr;
+        int pitch = 0;
+        if((!dirty.empty()) && (SDL_LockTexture(tex, &rect, &dst, &pitch) == 0))
+        {
+            for(uint16_t y = dirty.y0; y < dirty.y1; ++y)
+            {
+                auto * const row = reinterpret_cast<uint32_t *>(static_cast<uint8_t *>(dst) + ((y - dirty.y0) * pitch));
+                ffr::Convert555to8888<ffr::PixelFormat::XRGB8888>(pixels + (y * width) + dirty.x0, row, rect.w);
+            }
+            SDL_UnlockTexture(tex);
+        }
+        SDL_RenderCopy(ren, tex, nullptr, nullptr);
         SDL_RenderPresent(ren);
     }
 
-    void plot(uint16_t x, uint16_t y, uint16_t c) override
-    {
-        auto cc = ffr::Convert555to888(c);
-        SDL_SetRenderDrawColor(ren,cc[0],cc[1],cc[2],255);
-        SDL_RenderDrawPoint(ren,x,y);
-    }
-
 private:
     SDL_Window* win;
     SDL_Renderer* ren;
-};
-
-
-class VF : public ffr::VertexFunction
-{
-public:
-
-    ffr::math::mat4 mv, pj;
-
-    auto operator()(ffr::math::vec4& in) -> void override
-    {
-
-        in = pj * mv * in;
-
-        //in.w = in.z * 2.0_fx;
-    }
-
+    SDL_Texture* tex;
 };
 
 
@@ -81,13 +74,13 @@ auto main(int argc, char *argv[]) -> int
 
     SDL_Init(SDL_INIT_VIDEO);
 
-    VF vf;
-    vf.pj = ffr::math::mat4::perspective(90.0_fx,0.6666_fx,1.0_fx, 1000.0_fx);
     ffr::math::fixed32 g = -3.0_fx;
 
-    SDL_Context c;
+    SDL_Presenter p;
+    ffr::FramebufferContext<128, 240, 160> c;
+    c.setPresenter(&p);
+    c.setProjection(ffr::math::mat4::perspective(90.0_fx,0.6666_fx,1.0_fx, 1000.0_fx));
     c.setViewPort(240,160);
-    c.setVertexFunction(&vf);
     c.setVertexPointer(3, (void*)(cv.data()));
     c.setColorPointer(car);
 
@@ -125,8 +118,8 @@ auto main(int argc, char *argv[]) -> int
         c.present();
 
 
-        vf.mv = ffr::math::mat4::translation(ffr::math::vec3{0.0_fx,0.0_fx,-6.0_fx});
-        vf.mv = vf.mv * ffr::math::mat4::rotationY(g);
+        c.loadMatrix(ffr::math::mat4::translation(ffr::math::vec3{0.0_fx,0.0_fx,-6.0_fx}));
+        c.multMatrix(ffr::math::mat4::rotationY(g));
         g = g - 0.001_fx;
 
 
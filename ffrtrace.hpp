@@ -0,0 +1,586 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "ffr.hpp"
+
+namespace ffr
+{
+
+//binary draw traces. a TraceWriter set as a context's TraceSink copies
+//every drawArray, drawElements and drawMesh into a byte stream together
+//with the state and the vertex, colour and index data it reads. a TracePlayer replays the stream
+//into any Context without touching the original data.
+//
+//native byte order, which is little endian on every target:
+//  header  "FFRTRACE", uint16_t version, uint16_t 0
+//  then records, each a uint8_t TraceRecord followed by its payload
+//  Data    uint32_t size, zeros up to a 4 byte boundary, size bytes, zeros up to 4
+//  State   int16_t view width, height, uint8_t blend mode, cull mode, front face,
+//          16 int32_t raw mvp column by column (m[col][row])
+//  Draw    uint8_t draw type, vertex type, components, fraction bits, flags,
+//          uint16_t first, count, uint32_t vertex data, colour data
+//  Frame   no payload
+//  DrawElements  uint8_t draw type, vertex type, components, fraction bits,
+//          flags, uint16_t count, uint32_t vertex data, colour data, index data
+//data records are numbered from 0 in stream order and shared by every draw
+//that reads identical bytes. vertices are stored tightly packed with only
+//their position, and first is rebased so a draw references the data it
+//reads and nothing else. indexed draws keep the vertices from their lowest
+//to their highest index, with the uint16_t indices rebased to match and
+//starting at 0. state is written when it changes. draw flag bit 0 marks
+//positions that went through a VertexFunction, which is not captured
+static_assert(std::endian::native == std::endian::little, "traces are little endian");
+
+enum class TraceRecord : uint8_t
+{
+    Data = 1,
+    State = 2,
+    Draw = 3,
+    Frame = 4,
+    DrawElements = 5
+};
+
+namespace
+{
+
+constexpr char TRACE_MAGIC[8] = {'F', 'F', 'R', 'T', 'R', 'A', 'C', 'E'};
+constexpr uint16_t TRACE_VERSION = 4;
+constexpr size_t TRACE_HEADER_SIZE = sizeof(TRACE_MAGIC) + 4;
+
+constexpr uint8_t TRACE_DRAW_VERTEX_FUNCTION = 1 << 0;
+
+//vertices per primitive, colours are indexed by first / this
+constexpr auto traceVerticesPerColor(DrawType const dt) -> uint16_t
+{
+    return (dt == DrawType::Triangles) ? 3 : ((dt == DrawType::Lines) ? 2 : 1);
+}
+
+}
+
+class TraceWriter : public TraceSink
+{
+public:
+    TraceWriter()
+    {
+        clear();
+    }
+
+    auto traceDraw(TracedDraw const & draw) -> void override
+    {
+        uint16_t const per_color = traceVerticesPerColor(draw.draw_type);
+        if(draw.indices)
+        {
+            trace_elements(draw, per_color);
+            return;
+        }
+
+        uint16_t const rebased_first = draw.first % per_color;
+        uint32_t const base = draw.first - rebased_first;
+        uint32_t const vertices = positions(draw, base, uint32_t(rebased_first) + draw.count);
+
+        uint32_t const color_first = draw.first / per_color;
+        uint32_t const color_count = ((uint32_t(draw.first) + draw.count) / per_color) - color_first;
+        uint32_t const colors = data(draw.colors + color_first, color_count * uint32_t(sizeof(uint16_t)));
+
+        state(draw);
+        put(TraceRecord::Draw);
+        put_format(draw);
+        put(rebased_first);
+        put(draw.count);
+        put(vertices);
+        put(colors);
+        draw_count_++;
+    }
+
+    //marks the end of a frame, call before or after present()
+    auto endFrame() -> void
+    {
+        put(TraceRecord::Frame);
+        frame_count_++;
+    }
+
+    //drop everything written so far
+    auto clear() -> void
+    {
+        data_index_.clear();
+        data_count_ = 0;
+        draw_count_ = 0;
+        frame_count_ = 0;
+        has_state_ = false;
+
+        bytes_.assign(TRACE_MAGIC, TRACE_MAGIC + sizeof(TRACE_MAGIC));
+        put(TRACE_VERSION);
+        put(uint16_t(0));
+    }
+
+    auto bytes() const -> uint8_t const *
+    {
+        return bytes_.data();
+    }
+
+    auto size() const -> size_t
+    {
+        return bytes_.size();
+    }
+
+    auto drawCount() const -> uint32_t
+    {
+        return draw_count_;
+    }
+
+    auto frameCount() const -> uint32_t
+    {
+        return frame_count_;
+    }
+
+private:
+    class DataRecord
+    {
+    public:
+        size_t offset;
+        uint32_t size;
+        uint32_t index;
+    };
+
+    std::vector<uint8_t> bytes_;
+    std::vector<uint8_t> scratch_;
+    std::vector<uint16_t> indices_;
+    std::unordered_multimap<uint64_t, DataRecord> data_index_;
+    uint32_t data_count_ = 0;
+    uint32_t draw_count_ = 0;
+    uint32_t frame_count_ = 0;
+
+    bool has_state_ = false;
+    int16_t view_width_ = 0;
+    int16_t view_height_ = 0;
+    BlendMode blend_mode_ = BlendMode::Opaque;
+    CullMode cull_mode_ = CullMode::Back;
+    FrontFace front_face_ = FrontFace::CounterClockwise;
+    math::mat4 mvp_;
+
+    auto trace_elements(TracedDraw const & draw, uint16_t const per_color) -> void
+    {
+        uint16_t const * const elements = draw.indices + draw.first;
+        uint16_t lo = UINT16_MAX;
+        uint16_t hi = 0;
+        for(uint16_t i = 0; i < draw.count; ++i)
+        {
+            lo = std::min(lo, elements[i]);
+            hi = std::max(hi, elements[i]);
+        }
+
+        indices_.resize(draw.count);
+        for(uint16_t i = 0; i < draw.count; ++i)
+        {
+            indices_[i] = uint16_t(elements[i] - lo);
+        }
+
+        uint32_t const vertices = positions(draw, lo, uint32_t(hi - lo) + 1);
+        uint32_t const colors = data(draw.colors + (draw.first / per_color), (draw.count / per_color) * uint32_t(sizeof(uint16_t)));
+        uint32_t const indices = data(indices_.data(), uint32_t(draw.count) * uint32_t(sizeof(uint16_t)));
+
+        state(draw);
+        put(TraceRecord::DrawElements);
+        put_format(draw);
+        put(draw.count);
+        put(vertices);
+        put(colors);
+        put(indices);
+        draw_count_++;
+    }
+
+    //count positions from vertex base, packed
+    auto positions(TracedDraw const & draw, uint32_t const base, uint32_t const count) -> uint32_t
+    {
+        uint32_t const element = uint32_t(draw.layout.componentSize()) * draw.layout.components;
+        uint32_t const stride = draw.layout.vertexStride();
+        auto const * const src = static_cast<uint8_t const *>(draw.vertices);
+        scratch_.resize(count * element);
+        for(uint32_t i = 0; i < count; ++i)
+        {
+            std::memcpy(scratch_.data() + (i * element), src + ((base + i) * stride) + draw.layout.offset, element);
+        }
+        return data(scratch_.data(), uint32_t(scratch_.size()));
+    }
+
+    //a State record if anything changed since the last one
+    auto state(TracedDraw const & draw) -> void
+    {
+        if(has_state_ && (draw.view_width == view_width_) && (draw.view_height == view_height_)
+           && (draw.blend_mode == blend_mode_) && (draw.cull_mode == cull_mode_) && (draw.front_face == front_face_)
+           && (draw.mvp == mvp_))
+        {
+            return;
+        }
+
+        view_width_ = draw.view_width;
+        view_height_ = draw.view_height;
+        blend_mode_ = draw.blend_mode;
+        cull_mode_ = draw.cull_mode;
+        front_face_ = draw.front_face;
+        mvp_ = draw.mvp;
+        has_state_ = true;
+
+        put(TraceRecord::State);
+        put(view_width_);
+        put(view_height_);
+        put(static_cast<uint8_t>(blend_mode_));
+        put(static_cast<uint8_t>(cull_mode_));
+        put(static_cast<uint8_t>(front_face_));
+        for(uint8_t r = 0; r < 4; ++r)
+        {
+            for(uint8_t c = 0; c < 4; ++c)
+            {
+                put(mvp_.m[r][c].raw());
+            }
+        }
+    }
+
+    //the fields Draw and DrawElements start with
+    auto put_format(TracedDraw const & draw) -> void
+    {
+        put(static_cast<uint8_t>(draw.draw_type));
+        put(static_cast<uint8_t>(draw.layout.type));
+        put(draw.layout.components);
+        put(draw.layout.fraction_bits);
+        put(uint8_t(draw.vertex_function ? TRACE_DRAW_VERTEX_FUNCTION : 0));
+    }
+
+    template<class T>
+    auto put(T const value) -> void
+    {
+        uint8_t b[sizeof(T)];
+        std::memcpy(b, &value, sizeof(T));
+        bytes_.insert(bytes_.end(), b, b + sizeof(T));
+    }
+
+    auto align() -> void
+    {
+        bytes_.resize((bytes_.size() + 3) & ~size_t(3), 0);
+    }
+
+    //index of a data record holding these bytes, written if no earlier one does
+    auto data(void const * src, uint32_t const size) -> uint32_t
+    {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for(uint32_t i = 0; i < size; ++i)
+        {
+            hash = (hash ^ static_cast<uint8_t const *>(src)[i]) * 0x100000001b3ull;
+        }
+
+        auto const [begin, end] = data_index_.equal_range(hash);
+        for(auto i = begin; i != end; ++i)
+        {
+            DataRecord const & d = i->second;
+            if((d.size == size) && ((size == 0) || (std::memcmp(bytes_.data() + d.offset, src, size) == 0)))
+            {
+                return d.index;
+            }
+        }
+
+        put(TraceRecord::Data);
+        put(size);
+        align();
+        size_t const offset = bytes_.size();
+        bytes_.resize(offset + size);
+        if(size) { std::memcpy(bytes_.data() + offset, src, size); }
+        align();
+
+        data_index_.emplace(hash, DataRecord{offset, size, data_count_});
+        return data_count_++;
+    }
+};
+
+
+class TracePlayer
+{
+public:
+    //copies and indexes a trace, false if it is not one this version can
+    //replay. replay then only sets pointers and draws
+    auto load(uint8_t const * src, size_t const size) -> bool
+    {
+        bytes_.assign(src, src + size);
+        data_.clear();
+        states_.clear();
+        draws_.clear();
+        frame_ends_.clear();
+
+        if(!parse())
+        {
+            bytes_.clear();
+            data_.clear();
+            states_.clear();
+            draws_.clear();
+            frame_ends_.clear();
+            return false;
+        }
+        return true;
+    }
+
+    auto drawCount() const -> uint32_t
+    {
+        return uint32_t(draws_.size());
+    }
+
+    //draws after the last frame marker count as one more frame
+    auto frameCount() const -> uint32_t
+    {
+        return uint32_t(frame_ends_.size());
+    }
+
+    //issues every traced draw. the context's viewport, blend and cull state,
+    //projection, modelview and pointers are overwritten. a vertex function set
+    //on it runs only for the draws that were traced with one, the rest use
+    //the traced mvp
+    template<uint8_t MAX_VERTS>
+    auto replay(Context<MAX_VERTS> & ctx) const -> void
+    {
+        replay_draws(ctx, 0, uint32_t(draws_.size()));
+    }
+
+    //issues the draws of one frame, without clear() or present()
+    template<uint8_t MAX_VERTS>
+    auto replayFrame(Context<MAX_VERTS> & ctx, uint32_t const frame) const -> void
+    {
+        if(frame >= frame_ends_.size()) { return; }
+        replay_draws(ctx, (frame == 0) ? 0 : frame_ends_[frame - 1], frame_ends_[frame]);
+    }
+
+private:
+    class Data
+    {
+    public:
+        size_t offset;
+        uint32_t size;
+    };
+
+    class State
+    {
+    public:
+        int16_t view_width;
+        int16_t view_height;
+        BlendMode blend_mode;
+        CullMode cull_mode;
+        FrontFace front_face;
+        math::mat4 mvp;
+    };
+
+    class Draw
+    {
+    public:
+        DrawType draw_type;
+        uint16_t first;
+        uint16_t count;
+        uint32_t state;
+        bool vertex_function;
+        bool indexed;
+        VertexLayout layout;
+        size_t vertices;        //offsets into bytes_
+        size_t colors;
+        size_t indices;
+    };
+
+    std::vector<uint8_t> bytes_;
+    std::vector<Data> data_;
+    std::vector<State> states_;
+    std::vector<Draw> draws_;
+    std::vector<uint32_t> frame_ends_;
+
+    template<uint8_t MAX_VERTS>
+    auto replay_draws(Context<MAX_VERTS> & ctx, uint32_t const begin, uint32_t const end) const -> void
+    {
+        //the traced mvp already includes the projection
+        ctx.setProjection(math::mat4{});
+        VertexFunction * const vertex_function = ctx.vertexFunction();
+
+        uint32_t state = UINT32_MAX;
+        for(uint32_t i = begin; i < end; ++i)
+        {
+            Draw const & d = draws_[i];
+            if(d.state != state)
+            {
+                State const & s = states_[d.state];
+                ctx.setViewPort(s.view_width, s.view_height);
+                ctx.setBlendMode(s.blend_mode);
+                ctx.setCullMode(s.cull_mode);
+                ctx.setFrontFace(s.front_face);
+                ctx.loadMatrix(s.mvp);
+                state = d.state;
+            }
+            ctx.setVertexFunction(d.vertex_function ? vertex_function : nullptr);
+            ctx.setVertexPointer(d.layout, bytes_.data() + d.vertices);
+            ctx.setColorPointer(reinterpret_cast<uint16_t const *>(bytes_.data() + d.colors));
+            if(d.indexed)
+            {
+                ctx.drawElements(d.draw_type, 0, d.count, reinterpret_cast<uint16_t const *>(bytes_.data() + d.indices));
+            }
+            else
+            {
+                ctx.drawArray(d.draw_type, d.first, d.count);
+            }
+        }
+        ctx.setVertexFunction(vertex_function);
+    }
+
+    template<class T>
+    auto get(size_t & at, T & value) const -> bool
+    {
+        if(bytes_.size() - at < sizeof(T)) { return false; }
+        std::memcpy(&value, bytes_.data() + at, sizeof(T));
+        at += sizeof(T);
+        return true;
+    }
+
+    auto parse() -> bool
+    {
+        uint16_t version = 0;
+        uint16_t reserved = 0;
+        size_t at = sizeof(TRACE_MAGIC);
+        if((bytes_.size() < TRACE_HEADER_SIZE) || (std::memcmp(bytes_.data(), TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0)
+           || !get(at, version) || !get(at, reserved) || (version != TRACE_VERSION))
+        {
+            return false;
+        }
+
+        while(at < bytes_.size())
+        {
+            TraceRecord record;
+            get(at, record);
+            switch(record)
+            {
+            case TraceRecord::Data:
+            {
+                uint32_t size = 0;
+                if(!get(at, size)) { return false; }
+                at = (at + 3) & ~size_t(3);
+                if((at > bytes_.size()) || (bytes_.size() - at < size)) { return false; }
+                data_.push_back({at, size});
+                at = std::min((at + size + 3) & ~size_t(3), bytes_.size());
+                break;
+            }
+            case TraceRecord::State:
+            {
+                State s;
+                uint8_t blend = 0;
+                uint8_t cull = 0;
+                uint8_t face = 0;
+                if(!get(at, s.view_width) || !get(at, s.view_height) || !get(at, blend) || !get(at, cull) || !get(at, face)
+                   || (blend > static_cast<uint8_t>(BlendMode::Average)) || (cull > static_cast<uint8_t>(CullMode::None))
+                   || (face > static_cast<uint8_t>(FrontFace::Clockwise)))
+                {
+                    return false;
+                }
+                s.blend_mode = static_cast<BlendMode>(blend);
+                s.cull_mode = static_cast<CullMode>(cull);
+                s.front_face = static_cast<FrontFace>(face);
+                for(uint8_t r = 0; r < 4; ++r)
+                {
+                    for(uint8_t c = 0; c < 4; ++c)
+                    {
+                        int32_t raw = 0;
+                        if(!get(at, raw)) { return false; }
+                        s.mvp.m[r][c] = math::fixed32::fromRaw(raw);
+                    }
+                }
+                states_.push_back(s);
+                break;
+            }
+            case TraceRecord::Draw:
+            {
+                if(!parse_draw(at, false)) { return false; }
+                break;
+            }
+            case TraceRecord::DrawElements:
+            {
+                if(!parse_draw(at, true)) { return false; }
+                break;
+            }
+            case TraceRecord::Frame:
+                frame_ends_.push_back(uint32_t(draws_.size()));
+                break;
+            default:
+                return false;
+            }
+        }
+
+        if(frame_ends_.empty() ? !draws_.empty() : (frame_ends_.back() != draws_.size()))
+        {
+            frame_ends_.push_back(uint32_t(draws_.size()));
+        }
+        return true;
+    }
+
+    auto parse_draw(size_t & at, bool const indexed) -> bool
+    {
+        uint8_t draw_type = 0;
+        uint8_t vertex_type = 0;
+        uint8_t flags = 0;
+        uint32_t vertices = 0;
+        uint32_t colors = 0;
+        uint32_t indices = 0;
+        Draw d;
+        d.first = 0;
+        d.indices = 0;
+        if(!get(at, draw_type) || !get(at, vertex_type) || !get(at, d.layout.components) || !get(at, d.layout.fraction_bits)
+           || !get(at, flags) || (!indexed && !get(at, d.first)) || !get(at, d.count) || !get(at, vertices) || !get(at, colors)
+           || (indexed && !get(at, indices)))
+        {
+            return false;
+        }
+
+        //every draw must follow a state and reference earlier data that
+        //covers what it reads
+        if((draw_type < static_cast<uint8_t>(DrawType::Points)) || (draw_type > static_cast<uint8_t>(DrawType::Triangles))
+           || (vertex_type < static_cast<uint8_t>(VertexType::Fixed32)) || (vertex_type > static_cast<uint8_t>(VertexType::Int8))
+           || (d.layout.components < 2) || (d.layout.components > 3) || (d.layout.fraction_bits > 16)
+           || ((flags & ~TRACE_DRAW_VERTEX_FUNCTION) != 0)
+           || states_.empty() || (vertices >= data_.size()) || (colors >= data_.size())
+           || (indexed && (indices >= data_.size())))
+        {
+            return false;
+        }
+        d.draw_type = static_cast<DrawType>(draw_type);
+        d.layout.type = static_cast<VertexType>(vertex_type);
+        d.vertex_function = (flags & TRACE_DRAW_VERTEX_FUNCTION) != 0;
+        d.indexed = indexed;
+
+        //an indexed draw reads up to its highest index
+        uint32_t const per_color = traceVerticesPerColor(d.draw_type);
+        uint32_t vertex_count = uint32_t(d.first) + d.count;
+        uint32_t color_count = (uint32_t(d.first) + d.count) / per_color;
+        if(indexed)
+        {
+            if(data_[indices].size < uint32_t(d.count) * sizeof(uint16_t)) { return false; }
+
+            uint16_t hi = 0;
+            for(uint16_t i = 0; i < d.count; ++i)
+            {
+                uint16_t index = 0;
+                std::memcpy(&index, bytes_.data() + data_[indices].offset + (i * sizeof(uint16_t)), sizeof(index));
+                hi = std::max(hi, index);
+            }
+            vertex_count = uint32_t(hi) + 1;
+            color_count = d.count / per_color;
+            d.indices = data_[indices].offset;
+        }
+
+        uint32_t const vertex_bytes = vertex_count * d.layout.vertexStride();
+        uint32_t const color_bytes = color_count * uint32_t(sizeof(uint16_t));
+        if((data_[vertices].size < vertex_bytes) || (data_[colors].size < color_bytes)) { return false; }
+
+        d.state = uint32_t(states_.size() - 1);
+        d.vertices = data_[vertices].offset;
+        d.colors = data_[colors].offset;
+        draws_.push_back(d);
+        return true;
+    }
+};
+
+}